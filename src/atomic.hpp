@@ -2,219 +2,1725 @@
 
 #include "atomic_ops.h"
 #include <atomic>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <type_traits>
 #include <utility>
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+AO_API void AO_pause(int); // defined in atomic_ops.c
+}
+
 namespace ao {
 
-template<typename T1, typename T2>
-class datomic
+namespace detail {
+
+// The bodies of the ops<>::* member templates below: select the unordered,
+// _acquire, _release or _full variant of an AO primitive at compile time.
+#define AO_CXX_LOAD_DISPATCH(order, fn, ...)                                       \
+    if constexpr(order == std::memory_order_relaxed) {                             \
+        return fn(__VA_ARGS__);                                                    \
+    }                                                                              \
+    else if constexpr(order == std::memory_order_consume || order == std::memory_order_acquire) { \
+        return fn##_acquire(__VA_ARGS__);                                          \
+    }                                                                              \
+    else {                                                                         \
+        return fn##_full(__VA_ARGS__);                                             \
+    }
+
+#define AO_CXX_STORE_DISPATCH(order, fn, ...)                                      \
+    if constexpr(order == std::memory_order_relaxed) {                             \
+        fn(__VA_ARGS__);                                                           \
+    }                                                                              \
+    else if constexpr(order == std::memory_order_release) {                        \
+        fn##_release(__VA_ARGS__);                                                 \
+    }                                                                              \
+    else {                                                                         \
+        fn##_full(__VA_ARGS__);                                                    \
+    }
+
+#define AO_CXX_RMW_DISPATCH(order, fn, ...)                                        \
+    if constexpr(order == std::memory_order_relaxed) {                             \
+        return fn(__VA_ARGS__);                                                    \
+    }                                                                              \
+    else if constexpr(order == std::memory_order_consume || order == std::memory_order_acquire) { \
+        return fn##_acquire(__VA_ARGS__);                                          \
+    }                                                                              \
+    else if constexpr(order == std::memory_order_release) {                        \
+        return fn##_release(__VA_ARGS__);                                          \
+    }                                                                              \
+    else {                                                                         \
+        return fn##_full(__VA_ARGS__);                                             \
+    }
+
+// The AO_char_*, AO_short_*, AO_int_* and AO_* primitive families.
+enum class width { char_, short_, int_, word };
+
+// Whether the target has a CAS of the family (the AO_t one is always
+// there, emulated if need be). The narrower families are optional, a
+// value whose own family is missing goes to the next wider one.
+template<width W>
+constexpr bool have_cas = true;
+#if !defined(AO_HAVE_char_fetch_compare_and_swap_full)
+template<>
+constexpr bool have_cas<width::char_> = false;
+#endif
+#if !defined(AO_HAVE_short_fetch_compare_and_swap_full)
+template<>
+constexpr bool have_cas<width::short_> = false;
+#endif
+#if !defined(AO_HAVE_int_fetch_compare_and_swap_full)
+template<>
+constexpr bool have_cas<width::int_> = false;
+#endif
+
+template<typename T>
+constexpr auto width_of =
+    sizeof(T) == sizeof(AO_t)                                          ? width::word
+    : sizeof(T) == sizeof(unsigned char) && have_cas<width::char_>     ? width::char_
+    : sizeof(T) <= sizeof(unsigned short) && have_cas<width::short_>   ? width::short_
+    : sizeof(T) <= sizeof(unsigned) && have_cas<width::int_>           ? width::int_
+                                                                       : width::word;
+
+template<width W>
+struct ops;
+
+#if defined(AO_HAVE_char_fetch_compare_and_swap_full)
+template<>
+struct ops<width::char_>
+{
+    using storage_type = unsigned char;
+
+    template<std::memory_order Order>
+    static auto load(const volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_LOAD_DISPATCH(Order, AO_char_load, addr)
+    }
+
+    template<std::memory_order Order>
+    static auto store(volatile storage_type* addr, storage_type val) noexcept -> void
+    {
+        AO_CXX_STORE_DISPATCH(Order, AO_char_store, addr, val)
+    }
+
+    template<std::memory_order Order>
+    static auto fetch_compare_and_swap(volatile storage_type* addr,
+                                       storage_type old_val,
+                                       storage_type new_val) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_char_fetch_compare_and_swap, addr, old_val, new_val)
+    }
+
+#if defined(AO_HAVE_char_fetch_and_add_full)
+    static constexpr bool have_fetch_and_add = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_add(volatile storage_type* addr, storage_type incr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_char_fetch_and_add, addr, incr)
+    }
+#else
+    static constexpr bool have_fetch_and_add = false;
+#endif
+
+#if defined(AO_HAVE_char_fetch_and_add1_full)
+    static constexpr bool have_fetch_and_add1 = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_add1(volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_char_fetch_and_add1, addr)
+    }
+#else
+    static constexpr bool have_fetch_and_add1 = false;
+#endif
+
+#if defined(AO_HAVE_char_fetch_and_sub1_full)
+    static constexpr bool have_fetch_and_sub1 = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_sub1(volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_char_fetch_and_sub1, addr)
+    }
+#else
+    static constexpr bool have_fetch_and_sub1 = false;
+#endif
+
+#if defined(AO_HAVE_char_and_full)
+    static constexpr bool have_and = true;
+
+    template<std::memory_order Order>
+    static auto and_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_char_and, addr, mask)
+    }
+#else
+    static constexpr bool have_and = false;
+#endif
+
+#if defined(AO_HAVE_char_or_full)
+    static constexpr bool have_or = true;
+
+    template<std::memory_order Order>
+    static auto or_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_char_or, addr, mask)
+    }
+#else
+    static constexpr bool have_or = false;
+#endif
+
+#if defined(AO_HAVE_char_xor_full)
+    static constexpr bool have_xor = true;
+
+    template<std::memory_order Order>
+    static auto xor_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_char_xor, addr, mask)
+    }
+#else
+    static constexpr bool have_xor = false;
+#endif
+};
+#endif // AO_HAVE_char_fetch_compare_and_swap_full
+
+#if defined(AO_HAVE_short_fetch_compare_and_swap_full)
+template<>
+struct ops<width::short_>
+{
+    using storage_type = unsigned short;
+
+    template<std::memory_order Order>
+    static auto load(const volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_LOAD_DISPATCH(Order, AO_short_load, addr)
+    }
+
+    template<std::memory_order Order>
+    static auto store(volatile storage_type* addr, storage_type val) noexcept -> void
+    {
+        AO_CXX_STORE_DISPATCH(Order, AO_short_store, addr, val)
+    }
+
+    template<std::memory_order Order>
+    static auto fetch_compare_and_swap(volatile storage_type* addr,
+                                       storage_type old_val,
+                                       storage_type new_val) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_short_fetch_compare_and_swap, addr, old_val, new_val)
+    }
+
+#if defined(AO_HAVE_short_fetch_and_add_full)
+    static constexpr bool have_fetch_and_add = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_add(volatile storage_type* addr, storage_type incr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_short_fetch_and_add, addr, incr)
+    }
+#else
+    static constexpr bool have_fetch_and_add = false;
+#endif
+
+#if defined(AO_HAVE_short_fetch_and_add1_full)
+    static constexpr bool have_fetch_and_add1 = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_add1(volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_short_fetch_and_add1, addr)
+    }
+#else
+    static constexpr bool have_fetch_and_add1 = false;
+#endif
+
+#if defined(AO_HAVE_short_fetch_and_sub1_full)
+    static constexpr bool have_fetch_and_sub1 = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_sub1(volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_short_fetch_and_sub1, addr)
+    }
+#else
+    static constexpr bool have_fetch_and_sub1 = false;
+#endif
+
+#if defined(AO_HAVE_short_and_full)
+    static constexpr bool have_and = true;
+
+    template<std::memory_order Order>
+    static auto and_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_short_and, addr, mask)
+    }
+#else
+    static constexpr bool have_and = false;
+#endif
+
+#if defined(AO_HAVE_short_or_full)
+    static constexpr bool have_or = true;
+
+    template<std::memory_order Order>
+    static auto or_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_short_or, addr, mask)
+    }
+#else
+    static constexpr bool have_or = false;
+#endif
+
+#if defined(AO_HAVE_short_xor_full)
+    static constexpr bool have_xor = true;
+
+    template<std::memory_order Order>
+    static auto xor_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_short_xor, addr, mask)
+    }
+#else
+    static constexpr bool have_xor = false;
+#endif
+};
+#endif // AO_HAVE_short_fetch_compare_and_swap_full
+
+#if defined(AO_HAVE_int_fetch_compare_and_swap_full)
+template<>
+struct ops<width::int_>
+{
+    using storage_type = unsigned int;
+
+    template<std::memory_order Order>
+    static auto load(const volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_LOAD_DISPATCH(Order, AO_int_load, addr)
+    }
+
+    template<std::memory_order Order>
+    static auto store(volatile storage_type* addr, storage_type val) noexcept -> void
+    {
+        AO_CXX_STORE_DISPATCH(Order, AO_int_store, addr, val)
+    }
+
+    template<std::memory_order Order>
+    static auto fetch_compare_and_swap(volatile storage_type* addr,
+                                       storage_type old_val,
+                                       storage_type new_val) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_int_fetch_compare_and_swap, addr, old_val, new_val)
+    }
+
+#if defined(AO_HAVE_int_fetch_and_add_full)
+    static constexpr bool have_fetch_and_add = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_add(volatile storage_type* addr, storage_type incr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_int_fetch_and_add, addr, incr)
+    }
+#else
+    static constexpr bool have_fetch_and_add = false;
+#endif
+
+#if defined(AO_HAVE_int_fetch_and_add1_full)
+    static constexpr bool have_fetch_and_add1 = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_add1(volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_int_fetch_and_add1, addr)
+    }
+#else
+    static constexpr bool have_fetch_and_add1 = false;
+#endif
+
+#if defined(AO_HAVE_int_fetch_and_sub1_full)
+    static constexpr bool have_fetch_and_sub1 = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_sub1(volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_int_fetch_and_sub1, addr)
+    }
+#else
+    static constexpr bool have_fetch_and_sub1 = false;
+#endif
+
+#if defined(AO_HAVE_int_and_full)
+    static constexpr bool have_and = true;
+
+    template<std::memory_order Order>
+    static auto and_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_int_and, addr, mask)
+    }
+#else
+    static constexpr bool have_and = false;
+#endif
+
+#if defined(AO_HAVE_int_or_full)
+    static constexpr bool have_or = true;
+
+    template<std::memory_order Order>
+    static auto or_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_int_or, addr, mask)
+    }
+#else
+    static constexpr bool have_or = false;
+#endif
+
+#if defined(AO_HAVE_int_xor_full)
+    static constexpr bool have_xor = true;
+
+    template<std::memory_order Order>
+    static auto xor_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_int_xor, addr, mask)
+    }
+#else
+    static constexpr bool have_xor = false;
+#endif
+};
+#endif // AO_HAVE_int_fetch_compare_and_swap_full
+
+template<>
+struct ops<width::word>
+{
+    using storage_type = AO_t;
+
+    template<std::memory_order Order>
+    static auto load(const volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_LOAD_DISPATCH(Order, AO_load, addr)
+    }
+
+    template<std::memory_order Order>
+    static auto store(volatile storage_type* addr, storage_type val) noexcept -> void
+    {
+        AO_CXX_STORE_DISPATCH(Order, AO_store, addr, val)
+    }
+
+    template<std::memory_order Order>
+    static auto fetch_compare_and_swap(volatile storage_type* addr,
+                                       storage_type old_val,
+                                       storage_type new_val) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_fetch_compare_and_swap, addr, old_val, new_val)
+    }
+
+#if defined(AO_HAVE_fetch_and_add_full)
+    static constexpr bool have_fetch_and_add = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_add(volatile storage_type* addr, storage_type incr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_fetch_and_add, addr, incr)
+    }
+#else
+    static constexpr bool have_fetch_and_add = false;
+#endif
+
+#if defined(AO_HAVE_fetch_and_add1_full)
+    static constexpr bool have_fetch_and_add1 = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_add1(volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_fetch_and_add1, addr)
+    }
+#else
+    static constexpr bool have_fetch_and_add1 = false;
+#endif
+
+#if defined(AO_HAVE_fetch_and_sub1_full)
+    static constexpr bool have_fetch_and_sub1 = true;
+
+    template<std::memory_order Order>
+    static auto fetch_and_sub1(volatile storage_type* addr) noexcept -> storage_type
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_fetch_and_sub1, addr)
+    }
+#else
+    static constexpr bool have_fetch_and_sub1 = false;
+#endif
+
+#if defined(AO_HAVE_and_full)
+    static constexpr bool have_and = true;
+
+    template<std::memory_order Order>
+    static auto and_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_and, addr, mask)
+    }
+#else
+    static constexpr bool have_and = false;
+#endif
+
+#if defined(AO_HAVE_or_full)
+    static constexpr bool have_or = true;
+
+    template<std::memory_order Order>
+    static auto or_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_or, addr, mask)
+    }
+#else
+    static constexpr bool have_or = false;
+#endif
+
+#if defined(AO_HAVE_xor_full)
+    static constexpr bool have_xor = true;
+
+    template<std::memory_order Order>
+    static auto xor_(volatile storage_type* addr, storage_type mask) noexcept -> void
+    {
+        AO_CXX_RMW_DISPATCH(Order, AO_xor, addr, mask)
+    }
+#else
+    static constexpr bool have_xor = false;
+#endif
+};
+
+// The load and store of an AO_TS_t, which is a byte or an AO_t. These do
+// not need a CAS, so they exist even where the ops<> table of that width
+// does not.
+struct ts_ops
+{
+    template<std::memory_order Order>
+    static auto load(const volatile AO_TS_t* addr) noexcept -> AO_TS_t
+    {
+        if constexpr(sizeof(AO_TS_t) == sizeof(unsigned char)) {
+            AO_CXX_LOAD_DISPATCH(Order, AO_char_load, reinterpret_cast<const volatile unsigned char*>(addr))
+        }
+        else {
+            AO_CXX_LOAD_DISPATCH(Order, AO_load, reinterpret_cast<const volatile AO_t*>(addr))
+        }
+    }
+
+    template<std::memory_order Order>
+    static auto store(volatile AO_TS_t* addr, AO_TS_t val) noexcept -> void
+    {
+        if constexpr(sizeof(AO_TS_t) == sizeof(unsigned char)) {
+            AO_CXX_STORE_DISPATCH(Order, AO_char_store, reinterpret_cast<volatile unsigned char*>(addr),
+                                  static_cast<unsigned char>(val))
+        }
+        else {
+            AO_CXX_STORE_DISPATCH(Order, AO_store, reinterpret_cast<volatile AO_t*>(addr),
+                                  static_cast<AO_t>(val))
+        }
+    }
+};
+
+#undef AO_CXX_RMW_DISPATCH
+#undef AO_CXX_STORE_DISPATCH
+#undef AO_CXX_LOAD_DISPATCH
+
+// Turns a runtime memory order into a call of f with the matching
+// std::integral_constant, so that the ordered primitive is picked at
+// compile time in each branch.
+template<typename F>
+inline auto with_order(std::memory_order order, F&& f) -> decltype(auto)
+{
+    switch(order) {
+    case std::memory_order_relaxed:
+        return f(std::integral_constant<std::memory_order, std::memory_order_relaxed>{});
+    case std::memory_order_consume:
+    case std::memory_order_acquire:
+        return f(std::integral_constant<std::memory_order, std::memory_order_acquire>{});
+    case std::memory_order_release:
+        return f(std::integral_constant<std::memory_order, std::memory_order_release>{});
+    case std::memory_order_acq_rel:
+    case std::memory_order_seq_cst: break;
+    }
+    return f(std::integral_constant<std::memory_order, std::memory_order_seq_cst>{});
+}
+
+// The order for a fetching CAS, which has one order for both outcomes: a
+// failure order stronger than the success one strengthens the whole CAS
+// (release + acquire, for example, takes the _full variant).
+constexpr auto cas_order(std::memory_order success, std::memory_order failure) noexcept
+    -> std::memory_order
+{
+    if(failure == std::memory_order_seq_cst) {
+        return std::memory_order_seq_cst;
+    }
+    if(failure == std::memory_order_consume || failure == std::memory_order_acquire) {
+        if(success == std::memory_order_relaxed) {
+            return std::memory_order_acquire;
+        }
+        if(success == std::memory_order_release) {
+            return std::memory_order_acq_rel;
+        }
+    }
+    return success;
+}
+
+// Whether the primitives of a family and the double-word ones work without
+// locks, i.e. do not come from generic_pthread.h or from the CAS emulation
+// in atomic_ops.c (which only stands in for the AO_t and double-word CAS).
+#if defined(AO_USE_PTHREAD_DEFS)
+template<width W>
+constexpr bool lock_free = false;
+#else
+template<width W>
+constexpr bool lock_free = have_cas<W>;
+#if defined(AO_EMULATED_CAS)
+template<>
+constexpr bool lock_free<width::word> = false;
+#endif
+#endif
+
+#if !defined(AO_HAVE_double_t) || defined(AO_USE_PTHREAD_DEFS) \
+    || defined(AO_EMULATED_DOUBLE_CAS)
+constexpr bool double_lock_free = false;
+#else
+constexpr bool double_lock_free = true;
+#endif
+
+// Conversions between a value and the unsigned word the primitives work on.
+// Integers and enumerations convert by value, anything else is copied
+// bytewise into a zeroed word, so that unused bytes compare equal in a CAS.
+template<typename S, typename T>
+constexpr auto to_storage(T val) noexcept -> S
+{
+    if constexpr(std::is_integral_v<T> || std::is_enum_v<T>) {
+        return static_cast<S>(val);
+    }
+    else {
+        S out{};
+        std::memcpy(&out, &val, sizeof(T));
+        return out;
+    }
+}
+
+template<typename T, typename S>
+constexpr auto from_storage(S val) noexcept -> T
+{
+    if constexpr(std::is_integral_v<T> || std::is_enum_v<T>) {
+        return static_cast<T>(val);
+    }
+    else {
+        T out;
+        std::memcpy(&out, &val, sizeof(T));
+        return out;
+    }
+}
+
+// An integer or pointer as an AO_t. The null pointer is special-cased so
+// that it converts in constant expressions as well, which keeps the
+// constructors taking nullptr constexpr.
+template<typename T>
+constexpr auto word_of(T val) noexcept -> AO_t
+{
+    if constexpr(std::is_pointer_v<T>) {
+        return val == nullptr ? AO_t{0} : reinterpret_cast<AO_t>(val);
+    }
+    else {
+        return static_cast<AO_t>(val);
+    }
+}
+
+// Blocking support for atomic<>::wait/notify_*. Values stored in a 32-bit
+// word are parked on with a futex on the value itself. Other widths park
+// on the epoch of a hashed slot instead, which every notify increments.
+// The waiters count lets notify skip the system call when nobody sleeps.
+// The slot table lives in atomic_ops.c, so that it is not duplicated in
+// each shared object including this header.
+struct wait_slot
+{
+    unsigned* epoch;
+    unsigned* waiters;
+};
+
+constexpr int wait_spin_rounds = 10;
+
+inline auto wait_slot_for(const volatile void* addr) noexcept -> wait_slot
+{
+    unsigned* slot = AO_wait_slot(addr);
+    return {&slot[0], &slot[1]};
+}
+
+#if defined(__linux__)
+inline auto futex_wait(const volatile void* addr, unsigned expected) noexcept -> void
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+inline auto futex_wake(const volatile void* addr, int count) noexcept -> void
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+#else
+// No futex: poll with the shortest AO_pause() sleep.
+inline auto futex_wait(const volatile void*, unsigned) noexcept -> void { AO_pause(12); }
+inline auto futex_wake(const volatile void*, int) noexcept -> void {}
+#endif
+
+template<typename Storage, typename Changed>
+auto wait_until(const volatile Storage* addr, Storage expected, Changed changed) noexcept -> void
+{
+    for(int i = 0; i < wait_spin_rounds; ++i) {
+        if(changed()) {
+            return;
+        }
+        AO_pause(i);
+    }
+
+    const auto slot = wait_slot_for(addr);
+    AO_int_fetch_and_add1_full(slot.waiters);
+    for(;;) {
+        if constexpr(sizeof(Storage) == 4) {
+            if(changed()) {
+                break;
+            }
+            futex_wait(addr, static_cast<unsigned>(expected));
+        }
+        else {
+            const auto epoch = AO_int_load_acquire(slot.epoch);
+            if(changed()) {
+                break;
+            }
+            futex_wait(slot.epoch, epoch);
+        }
+    }
+    AO_int_fetch_and_sub1_release(slot.waiters);
+}
+
+template<typename Storage>
+auto notify(const volatile Storage* addr, bool all) noexcept -> void
+{
+    const auto slot = wait_slot_for(addr);
+    if constexpr(sizeof(Storage) == 4) {
+        AO_nop_full();
+        if(AO_int_load(slot.waiters) != 0) {
+            futex_wake(addr, all ? INT_MAX : 1);
+        }
+    }
+    else {
+        // The slot may be shared with other addresses, so a single wakeup
+        // could go to the wrong waiter.
+        AO_int_fetch_and_add1_full(slot.epoch);
+        if(AO_int_load(slot.waiters) != 0) {
+            futex_wake(slot.epoch, INT_MAX);
+        }
+    }
+}
+
+// Where the atomic classes keep their value: inside the object for
+// ao::atomic and ao::datomic, in caller-owned memory for the _ref variants.
+template<typename S>
+class inline_storage
+{
+protected:
+    inline_storage() = default;
+    constexpr explicit inline_storage(S val) noexcept : value_(val) {}
+
+    auto addr() const noexcept -> S* { return const_cast<S*>(&value_); }
+
+private:
+    S value_{};
+};
+
+template<typename S>
+class ref_storage
+{
+protected:
+    explicit ref_storage(S* addr) noexcept : addr_(addr) { AO_ASSERT_ADDR_ALIGNED(addr); }
+
+    auto addr() const noexcept -> S* { return addr_; }
+
+private:
+    S* addr_;
+};
+
+} // namespace detail
+
+#if defined(AO_HAVE_double_t)
+
+namespace detail {
+
+template<typename T1, typename T2, template<typename> class Storage>
+class basic_datomic : public Storage<AO_double_t>
 {
 public:
     using value_type = std::pair<T1, T2>;
 
-    datomic() = default;
-    constexpr datomic(T1 val1, T2 val2) noexcept
+    static constexpr bool is_always_lock_free = double_lock_free;
+
+protected:
+    basic_datomic() = default;
+    constexpr basic_datomic(T1 val1, T2 val2) noexcept : Storage<AO_double_t>(to_double(val1, val2))
+    {
+    }
+    explicit basic_datomic(AO_double_t* addr) noexcept : Storage<AO_double_t>(addr) {}
+
+public:
+    template<std::memory_order Order>
+    auto load() const noexcept -> std::pair<T1, T2>
+    {
+        if constexpr(Order == std::memory_order_relaxed) {
+            return to_pair(AO_double_load(this->addr()));
+        }
+        else if constexpr(Order == std::memory_order_seq_cst) {
+            return to_pair(AO_double_load_full(this->addr()));
+        }
+        else {
+            return to_pair(AO_double_load_acquire(this->addr()));
+        }
+    }
+
+    auto load(std::memory_order order) const -> std::pair<T1, T2>
+    {
+        switch(order) {
+        case std::memory_order_relaxed: return load<std::memory_order_relaxed>();
+        case std::memory_order_consume:
+        case std::memory_order_acquire:
+        case std::memory_order_release:
+        case std::memory_order_acq_rel: return load<std::memory_order_acquire>();
+        case std::memory_order_seq_cst: return load<std::memory_order_seq_cst>();
+        }
+        return {};
+    }
+
+    // Seqlock-style read for (version, value) layouts, where every update
+    // changes the first half. Both halves are read with plain acquire loads
+    // and the version is checked again afterwards, so readers keep the line
+    // shared instead of taking it exclusive as a cmpxchg16b-based
+    // AO_double_load does. Only a version mismatch falls back to that load.
+    auto load_optimistic() const noexcept -> std::pair<T1, T2>
+    {
+        AO_double_t snapshot;
+        snapshot.AO_val1 = AO_load_acquire(&this->addr()->AO_val1);
+        snapshot.AO_val2 = AO_load_acquire(&this->addr()->AO_val2);
+        if(AO_EXPECT_FALSE(AO_load(&this->addr()->AO_val1) != snapshot.AO_val1)) {
+            return load<std::memory_order_acquire>();
+        }
+        return to_pair(snapshot);
+    }
+
+    template<std::memory_order Order>
+    auto store(T1 val1, T2 val2) noexcept -> void
+    {
+        const auto new_val = to_double(val1, val2);
+        if constexpr(Order == std::memory_order_relaxed) {
+            AO_double_store(this->addr(), new_val);
+        }
+        else if constexpr(Order == std::memory_order_seq_cst) {
+            AO_double_store_full(this->addr(), new_val);
+        }
+        else {
+            AO_double_store_release(this->addr(), new_val);
+        }
+    }
+
+    auto store(T1 val1, T2 val2, std::memory_order order) -> void
+    {
+        switch(order) {
+        case std::memory_order_relaxed: store<std::memory_order_relaxed>(val1, val2); break;
+        case std::memory_order_consume:
+        case std::memory_order_acquire:
+        case std::memory_order_release:
+        case std::memory_order_acq_rel: store<std::memory_order_release>(val1, val2); break;
+        case std::memory_order_seq_cst: store<std::memory_order_seq_cst>(val1, val2); break;
+        }
+    }
+
+    template<typename TT1, typename TT2>
+    auto exchange(std::pair<TT1, TT2> new_val, std::memory_order order) -> std::pair<T1, T2>
+    {
+        return exchange(new_val.first, new_val.second, order);
+    }
+
+    template<typename TT1, typename TT2>
+    auto exchange(TT1 new_val1, TT2 new_val2, std::memory_order order) -> std::pair<T1, T2>
+    {
+        auto val = load(order);
+        while(true) {
+            if(compare_exchange_strong(val, new_val1, new_val2, order, std::memory_order_relaxed)){
+                return val;
+            }
+        }
+    }
+
+    template<typename TT1, typename TT2>
+    auto compare_exchange_strong(T1& old_val1,
+                                 T2& old_val2,
+                                 TT1 new_val1,
+                                 TT2 new_val2,
+                                 std::memory_order success,
+                                 std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        const auto old_w = to_double(old_val1, old_val2);
+        const auto new_w = to_double(new_val1, new_val2);
+#if defined(AO_HAVE_fetch_compare_double_and_swap_double_full)
+        // The fetching CAS already hands back the value it saw, so a failed
+        // exchange does not need to reload the value.
+        const auto fetched = detail::with_order(cas_order(success, failure), [&](auto order) {
+            return fetch_cas<decltype(order)::value>(old_w, new_w);
+        });
+        if(fetched.AO_val1 == old_w.AO_val1 && fetched.AO_val2 == old_w.AO_val2) {
+            return true;
+        }
+
+        const auto observed = to_pair(fetched);
+#else
+        const auto res = detail::with_order(success, [&](auto order) {
+            return cas<decltype(order)::value>(old_w, new_w);
+        });
+        if(res) {
+            return true;
+        }
+
+        const auto observed = load(failure);
+#endif
+        old_val1 = observed.first;
+        old_val2 = observed.second;
+        return false;
+    }
+
+    template<typename TT1, typename TT2>
+    auto compare_exchange_strong(std::pair<T1, T2>& old_val,
+                                 TT1 new_val1,
+                                 TT2 new_val2,
+                                 std::memory_order success,
+                                 std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        return compare_exchange_strong(old_val.first, old_val.second, new_val1, new_val2, success, failure);
+    }
+
+    template<typename TT1, typename TT2>
+    auto compare_exchange_strong(std::pair<T1, T2>& old_val,
+                                 std::pair<TT1, TT2> new_val,
+                                 std::memory_order success,
+                                 std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        return compare_exchange_strong(old_val, new_val.first, new_val.second, success, failure);
+    }
+
+    // Single-word CAS on the second half only, the first half is neither
+    // compared nor modified.
+    auto compare_exchange_second(T2& old_val2,
+                                 T2 new_val2,
+                                 std::memory_order success,
+                                 std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        using ops = detail::ops<detail::width::word>;
+        const auto expected = word_of(old_val2);
+        const auto fetched = detail::with_order(cas_order(success, failure), [&](auto order) {
+            return ops::fetch_compare_and_swap<decltype(order)::value>(
+                &this->addr()->AO_val2, expected, word_of(new_val2));
+        });
+        if(fetched == expected) {
+            return true;
+        }
+        old_val2 = second_from_word(fetched);
+        return false;
+    }
+private:
+
+    // The ordering comes from the matching AO_compare_double_and_swap_double
+    // variant itself, no extra AO_nop_* fences are needed around it.
+    template<std::memory_order Order>
+    auto cas(const AO_double_t& old_w, const AO_double_t& new_w) noexcept -> int
+    {
+        const auto o1 = old_w.AO_val1;
+        const auto o2 = old_w.AO_val2;
+        const auto n1 = new_w.AO_val1;
+        const auto n2 = new_w.AO_val2;
+        if constexpr(Order == std::memory_order_relaxed) {
+            return AO_compare_double_and_swap_double(this->addr(), o1, o2, n1, n2);
+        }
+        else if constexpr(Order == std::memory_order_consume || Order == std::memory_order_acquire) {
+            return AO_compare_double_and_swap_double_acquire(this->addr(), o1, o2, n1, n2);
+        }
+        else if constexpr(Order == std::memory_order_release) {
+            return AO_compare_double_and_swap_double_release(this->addr(), o1, o2, n1, n2);
+        }
+        else {
+            return AO_compare_double_and_swap_double_full(this->addr(), o1, o2, n1, n2);
+        }
+    }
+
+#if defined(AO_HAVE_fetch_compare_double_and_swap_double_full)
+    template<std::memory_order Order>
+    auto fetch_cas(const AO_double_t& old_w, const AO_double_t& new_w) noexcept -> AO_double_t
+    {
+        const auto o1 = old_w.AO_val1;
+        const auto o2 = old_w.AO_val2;
+        const auto n1 = new_w.AO_val1;
+        const auto n2 = new_w.AO_val2;
+        if constexpr(Order == std::memory_order_relaxed) {
+            return AO_fetch_compare_double_and_swap_double(this->addr(), o1, o2, n1, n2);
+        }
+        else if constexpr(Order == std::memory_order_consume || Order == std::memory_order_acquire) {
+            return AO_fetch_compare_double_and_swap_double_acquire(this->addr(), o1, o2, n1, n2);
+        }
+        else if constexpr(Order == std::memory_order_release) {
+            return AO_fetch_compare_double_and_swap_double_release(this->addr(), o1, o2, n1, n2);
+        }
+        else {
+            return AO_fetch_compare_double_and_swap_double_full(this->addr(), o1, o2, n1, n2);
+        }
+    }
+#endif
+
+    // AO_val1/AO_val2 rather than AO_parts, which the generic_pthread.h
+    // AO_double_t does not have. AO_parts is the first (active) member of the
+    // standard union, so this also constant-evaluates.
+    constexpr static auto to_double(T1 val1, T2 val2) noexcept -> AO_double_t
+    {
+        auto out = AO_double_t{};
+        out.AO_val1 = word_of(val1);
+        out.AO_val2 = word_of(val2);
+        return out;
+    }
+
+    constexpr static auto to_pair(AO_double_t value) noexcept -> std::pair<T1, T2>
+    {
+        std::pair<T1, T2> out;
+        if constexpr(std::is_pointer_v<T1>) {
+            out.first = reinterpret_cast<T1>(value.AO_val1);
+        }
+        else {
+            out.first = static_cast<T1>(value.AO_val1);
+        }
+
+        if constexpr(std::is_pointer_v<T2>) {
+            out.second = reinterpret_cast<T2>(value.AO_val2);
+        }
+        else {
+            out.second = static_cast<T2>(value.AO_val2);
+        }
+
+        return out;
+    }
+
+    constexpr static auto second_from_word(AO_t val) noexcept -> T2
+    {
+        if constexpr(std::is_pointer_v<T2>) {
+            return reinterpret_cast<T2>(val);
+        }
+        else {
+            return static_cast<T2>(val);
+        }
+    }
+
+};
+
+} // namespace detail
+
+template<typename T1, typename T2>
+class datomic : public detail::basic_datomic<T1, T2, detail::inline_storage>
+{
+    using base = detail::basic_datomic<T1, T2, detail::inline_storage>;
+
+public:
+    datomic() = default;
+    constexpr datomic(T1 val1, T2 val2) noexcept : base(val1, val2) {}
+    ~datomic() = default;
+
+    datomic(const datomic&) = default;
+    auto operator=(const datomic&) -> datomic& = default;
+    datomic(datomic&&) noexcept = delete;
+    auto operator=(datomic&&) noexcept -> datomic& = delete;
+};
+
+// The ao::datomic operations applied to a caller-owned AO_double_t, which
+// has to be aligned as required by the double-width primitives.
+template<typename T1, typename T2>
+class datomic_ref : public detail::basic_datomic<T1, T2, detail::ref_storage>
+{
+    using base = detail::basic_datomic<T1, T2, detail::ref_storage>;
+
+public:
+    explicit datomic_ref(AO_double_t& obj) noexcept : base(&obj) {}
+};
+
+// A (version, pointer) pair laid out like AO_stack_t.AO_vp: the version is
+// the first word and is incremented by every compare_exchange_strong, which
+// makes pops ABA-safe. compare_exchange_pointer is the narrow Treiber push
+// path of AO_stack_push_release, it swaps the pointer word only and keeps
+// the version.
+template<typename T>
+class tagged_ptr
+{
+public:
+    using value_type = std::pair<AO_t, T*>;
+
+    tagged_ptr() = default;
+    constexpr tagged_ptr(T* ptr) noexcept : value_(0, ptr) {}
+    ~tagged_ptr() = default;
+
+    tagged_ptr(const tagged_ptr&) = delete;
+    auto operator=(const tagged_ptr&) -> tagged_ptr& = delete;
+
+    template<std::memory_order Order>
+    auto load() const noexcept -> value_type
+    {
+        return value_.template load<Order>();
+    }
+
+    auto load(std::memory_order order) const -> value_type { return value_.load(order); }
+
+    // Still consistent with pointer-only pushes: they leave the version word
+    // alone, so any (version, pointer) seen here existed at some point.
+    auto load_optimistic() const noexcept -> value_type { return value_.load_optimistic(); }
+
+    // On success the stored version is old_val.first + 1, on failure old_val
+    // receives the current pair.
+    auto compare_exchange_strong(value_type& old_val,
+                                 T* new_ptr,
+                                 std::memory_order success,
+                                 std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        return value_.compare_exchange_strong(old_val, old_val.first + 1, new_ptr, success, failure);
+    }
+
+    auto compare_exchange_pointer(T*& old_ptr,
+                                  T* new_ptr,
+                                  std::memory_order success,
+                                  std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        return value_.compare_exchange_second(old_ptr, new_ptr, success, failure);
+    }
+
+private:
+    datomic<AO_t, T*> value_{0, nullptr};
+};
+
+#endif // AO_HAVE_double_t
+
+namespace detail {
+
+// Values of up to one AO_t use the AO_char/short/int/AO_t primitive family
+// of the smallest fitting width, larger ones (up to two words) the
+// AO_double_t primitives.
+template<typename T,
+         template<typename> class Storage,
+         bool Double = (sizeof(T) > sizeof(AO_t))>
+class basic_atomic : public Storage<typename ops<width_of<T>>::storage_type>
+{
+    static_assert(std::is_trivially_copyable_v<T>, "ao::atomic<T> requires a trivially copyable type");
+
+    using ops = detail::ops<detail::width_of<T>>;
+    using storage_type = typename ops::storage_type;
+
+protected:
+    basic_atomic() = default;
+    constexpr explicit basic_atomic(T val) noexcept
+        : Storage<storage_type>(to_storage<storage_type>(val))
+    {
+    }
+    explicit basic_atomic(T* obj) noexcept
+        : Storage<storage_type>(reinterpret_cast<storage_type*>(obj))
+    {
+        static_assert(sizeof(T) == sizeof(storage_type), "no AO primitives for this size");
+    }
+
+public:
+    static constexpr bool is_always_lock_free = lock_free<width_of<T>>;
+
+    template<std::memory_order Order>
+    auto load() const noexcept -> T
+    {
+        static_assert(Order != std::memory_order_release, "release on load?!");
+        return from_storage<T>(ops::template load<Order>(this->addr()));
+    }
+
+    auto load(std::memory_order order) const -> T
+    {
+        switch(order) {
+        case std::memory_order_relaxed: return load<std::memory_order_relaxed>();
+        case std::memory_order_consume:
+        case std::memory_order_acquire: return load<std::memory_order_acquire>();
+        case std::memory_order_release: assert(false && "release on load?!");
+        case std::memory_order_acq_rel:
+        case std::memory_order_seq_cst: return load<std::memory_order_seq_cst>();
+        }
+        return {};
+    }
+
+    template<std::memory_order Order, typename TT>
+    auto store(TT&& val) noexcept -> void
+    {
+        static_assert(Order != std::memory_order_consume && Order != std::memory_order_acquire,
+                      "acquire on store?!");
+        ops::template store<Order>(this->addr(), to_storage<storage_type>(static_cast<T>(val)));
+    }
+
+    template<typename TT>
+    auto store(TT&& val, std::memory_order order) -> void
+    {
+        switch(order) {
+        case std::memory_order_relaxed: store<std::memory_order_relaxed>(val); break;
+        case std::memory_order_consume:
+        case std::memory_order_acquire: assert(false && "acquire on store?!");
+        case std::memory_order_release: store<std::memory_order_release>(val); break;
+        case std::memory_order_acq_rel:
+        case std::memory_order_seq_cst: store<std::memory_order_seq_cst>(val); break;
+        }
+    }
+
+    // The expected value is refreshed from the CAS itself, so on failure it
+    // is exactly the value that made the exchange fail; the failure order
+    // is folded into the order of the CAS, see cas_order.
+    auto compare_exchange_strong(T& old_val,
+                                 T new_val,
+                                 std::memory_order success,
+                                 std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        const auto expected = to_storage<storage_type>(old_val);
+        const auto fetched = detail::with_order(cas_order(success, failure), [&](auto order) {
+            return ops::template fetch_compare_and_swap<decltype(order)::value>(
+                this->addr(), expected, to_storage<storage_type>(new_val));
+        });
+        if(fetched == expected) {
+            return true;
+        }
+        old_val = from_storage<T>(fetched);
+        return false;
+    }
+
+    // AO_fetch_compare_and_swap never fails spuriously.
+    auto compare_exchange_weak(T& old_val,
+                               T new_val,
+                               std::memory_order success,
+                               std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        return compare_exchange_strong(old_val, new_val, success, failure);
+    }
+
+    // The arithmetic and bitwise operations work on the value bits, so they
+    // are for integral T only (the operators below forward to them).
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_add(T arg) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        const auto incr = to_storage<storage_type>(arg);
+        if constexpr(ops::have_fetch_and_add) {
+            return from_storage<T>(ops::template fetch_and_add<Order>(this->addr(), incr));
+        }
+        else {
+            return fetch_update<Order>([incr](storage_type val) { return val + incr; });
+        }
+    }
+
+    auto fetch_add(T arg, std::memory_order order) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        return detail::with_order(order, [&](auto o) { return fetch_add<decltype(o)::value>(arg); });
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_sub(T arg) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        return fetch_add<Order>(from_storage<T>(0 - to_storage<storage_type>(arg)));
+    }
+
+    auto fetch_sub(T arg, std::memory_order order) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        return detail::with_order(order, [&](auto o) { return fetch_sub<decltype(o)::value>(arg); });
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_add1() noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        if constexpr(ops::have_fetch_and_add1) {
+            return from_storage<T>(ops::template fetch_and_add1<Order>(this->addr()));
+        }
+        else {
+            return fetch_update<Order>([](storage_type val) { return val + 1; });
+        }
+    }
+
+    auto fetch_add1(std::memory_order order) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        return detail::with_order(order, [&](auto o) { return fetch_add1<decltype(o)::value>(); });
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_sub1() noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        if constexpr(ops::have_fetch_and_sub1) {
+            return from_storage<T>(ops::template fetch_and_sub1<Order>(this->addr()));
+        }
+        else {
+            return fetch_update<Order>([](storage_type val) { return val - 1; });
+        }
+    }
+
+    auto fetch_sub1(std::memory_order order) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        return detail::with_order(order, [&](auto o) { return fetch_sub1<decltype(o)::value>(); });
+    }
+
+    // AO_and/AO_or/AO_xor do not report the previous value, so the fetch_*
+    // variants need a CAS loop.  Use bit_and/bit_or/bit_xor (or the compound
+    // assignment operators) when the old value is not needed.
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_and(T arg) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        const auto mask = to_storage<storage_type>(arg);
+        return fetch_update<Order>([mask](storage_type val) { return val & mask; });
+    }
+
+    auto fetch_and(T arg, std::memory_order order) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        return detail::with_order(order, [&](auto o) { return fetch_and<decltype(o)::value>(arg); });
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_or(T arg) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        const auto mask = to_storage<storage_type>(arg);
+        return fetch_update<Order>([mask](storage_type val) { return val | mask; });
+    }
+
+    auto fetch_or(T arg, std::memory_order order) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        return detail::with_order(order, [&](auto o) { return fetch_or<decltype(o)::value>(arg); });
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_xor(T arg) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        const auto mask = to_storage<storage_type>(arg);
+        return fetch_update<Order>([mask](storage_type val) { return val ^ mask; });
+    }
+
+    auto fetch_xor(T arg, std::memory_order order) noexcept -> T
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        return detail::with_order(order, [&](auto o) { return fetch_xor<decltype(o)::value>(arg); });
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto bit_and(T arg) noexcept -> void
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        if constexpr(ops::have_and) {
+            ops::template and_<Order>(this->addr(), to_storage<storage_type>(arg));
+        }
+        else {
+            fetch_and<Order>(arg);
+        }
+    }
+
+    auto bit_and(T arg, std::memory_order order) noexcept -> void
     {
-        if constexpr(std::is_pointer_v<T1>) {
-            value_.AO_parts.AO_v1 = reinterpret_cast<AO_t>(val1);
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        detail::with_order(order, [&](auto o) { bit_and<decltype(o)::value>(arg); });
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto bit_or(T arg) noexcept -> void
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        if constexpr(ops::have_or) {
+            ops::template or_<Order>(this->addr(), to_storage<storage_type>(arg));
         }
         else {
-            value_.AO_parts.AO_v1 = val1;
+            fetch_or<Order>(arg);
         }
+    }
 
-        if constexpr(std::is_pointer_v<T2>) {
-            value_.AO_parts.AO_v2 = reinterpret_cast<AO_t>(val2);
+    auto bit_or(T arg, std::memory_order order) noexcept -> void
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        detail::with_order(order, [&](auto o) { bit_or<decltype(o)::value>(arg); });
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto bit_xor(T arg) noexcept -> void
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        if constexpr(ops::have_xor) {
+            ops::template xor_<Order>(this->addr(), to_storage<storage_type>(arg));
         }
         else {
-            value_.AO_parts.AO_v2 = val2;
+            fetch_xor<Order>(arg);
         }
     }
-    ~datomic() = default;
 
-    datomic(const datomic&) = default;
-    auto operator=(const datomic&) -> datomic& = default;
-    datomic(datomic&&) noexcept = delete;
-    auto operator=(datomic&&) noexcept -> datomic& = delete;
+    auto bit_xor(T arg, std::memory_order order) noexcept -> void
+    {
+        static_assert(std::is_integral_v<T>, "arithmetic on a non-integral ao::atomic<T>");
+        detail::with_order(order, [&](auto o) { bit_xor<decltype(o)::value>(arg); });
+    }
 
-    auto load(std::memory_order order) const -> std::pair<T1, T2>
+    auto operator++() noexcept -> T { return from_storage<T>(fetch_add1() + 1); }
+    auto operator++(int) noexcept -> T { return fetch_add1(); }
+    auto operator--() noexcept -> T { return from_storage<T>(fetch_sub1() - 1); }
+    auto operator--(int) noexcept -> T { return fetch_sub1(); }
+    // Blocks until the value differs from old: spins briefly, then parks
+    // the thread until a notify_one/notify_all.
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto wait(T old) const noexcept -> void
+    {
+        static_assert(Order != std::memory_order_release, "release on load?!");
+        const auto expected = to_storage<storage_type>(old);
+        detail::wait_until(this->addr(), expected, [this, expected] {
+            return ops::template load<Order>(this->addr()) != expected;
+        });
+    }
+
+    auto wait(T old, std::memory_order order) const noexcept -> void
     {
         switch(order) {
-            case std::memory_order_relaxed:
-                return to_pair(AO_double_load(&value_));
-            case std::memory_order_consume:
-            case std::memory_order_acquire:
-            case std::memory_order_release:
-            case std::memory_order_acq_rel:
-                return to_pair(AO_double_load_acquire(&value_));
-            case std::memory_order_seq_cst:
-                return to_pair(AO_double_load_full(&value_));
-          break;
+        case std::memory_order_relaxed: wait<std::memory_order_relaxed>(old); break;
+        case std::memory_order_consume:
+        case std::memory_order_acquire: wait<std::memory_order_acquire>(old); break;
+        case std::memory_order_release: assert(false && "release on load?!");
+        case std::memory_order_acq_rel:
+        case std::memory_order_seq_cst: wait<std::memory_order_seq_cst>(old); break;
         }
-        return {};
     }
 
-    auto store(T1 val1, T2 val2, std::memory_order order) -> void
+    auto notify_one() noexcept -> void { detail::notify(this->addr(), false); }
+    auto notify_all() noexcept -> void { detail::notify(this->addr(), true); }
+
+    auto operator+=(T arg) noexcept -> T { return from_storage<T>(fetch_add(arg) + arg); }
+    auto operator-=(T arg) noexcept -> T { return from_storage<T>(fetch_sub(arg) - arg); }
+    auto operator&=(T arg) noexcept -> void { bit_and(arg); }
+    auto operator|=(T arg) noexcept -> void { bit_or(arg); }
+    auto operator^=(T arg) noexcept -> void { bit_xor(arg); }
+
+private:
+    // Generic read-modify-write fallback for the primitives that are
+    // missing on the target (or cannot return the previous value).
+    template<std::memory_order Order, typename F>
+    auto fetch_update(F op) noexcept -> T
     {
-        auto new_val = AO_double_t{};
-        if constexpr(std::is_pointer_v<T1>) {
-            new_val.AO_parts.AO_v1 = reinterpret_cast<AO_t>(val1);
-        }
-        else {
-            new_val.AO_parts.AO_v1 = val1;
-        }
-        if constexpr(std::is_pointer_v<T2>) {
-            new_val.AO_parts.AO_v2 = reinterpret_cast<AO_t>(val2);
-        }
-        else {
-            new_val.AO_parts.AO_v2 = val2;
+        auto old_val = ops::template load<std::memory_order_relaxed>(this->addr());
+        for(;;) {
+            const auto fetched = ops::template fetch_compare_and_swap<Order>(
+                this->addr(), old_val, to_storage<storage_type>(op(old_val)));
+            if(fetched == old_val) {
+                return from_storage<T>(old_val);
+            }
+            old_val = fetched;
         }
+    }
+
+};
+
+template<typename T, template<typename> class Storage>
+class basic_atomic<T*, Storage, false> : public Storage<AO_t>
+{
+    static_assert(sizeof(T*) == sizeof(AO_t), "pointers must fit into AO_t");
+
+    using ops = detail::ops<detail::width::word>;
+
+protected:
+    basic_atomic() = default;
+    constexpr explicit basic_atomic(T* val) noexcept : Storage<AO_t>(word_of(val)) {}
+    explicit basic_atomic(T** obj) noexcept : Storage<AO_t>(reinterpret_cast<AO_t*>(obj)) {}
+
+public:
+    static constexpr bool is_always_lock_free = lock_free<width::word>;
 
+    template<std::memory_order Order>
+    auto load() const noexcept -> T*
+    {
+        static_assert(Order != std::memory_order_release, "release on load?!");
+        return to_pointer(ops::load<Order>(this->addr()));
+    }
+
+    auto load(std::memory_order order) const -> T*
+    {
         switch(order) {
-            case std::memory_order_relaxed:
-                AO_double_store(&value_, new_val);
-            case std::memory_order_consume:
-            case std::memory_order_acquire:
-            case std::memory_order_release:
-            case std::memory_order_acq_rel:
-                AO_double_store_release(&value_, new_val);
-            case std::memory_order_seq_cst:
-                AO_double_store_full(&value_, new_val);
-          break;
+        case std::memory_order_relaxed: return load<std::memory_order_relaxed>();
+        case std::memory_order_consume:
+        case std::memory_order_acquire: return load<std::memory_order_acquire>();
+        case std::memory_order_release: assert(false && "release on load?!");
+        case std::memory_order_acq_rel:
+        case std::memory_order_seq_cst: return load<std::memory_order_seq_cst>();
         }
+        return nullptr;
     }
 
-    template<typename TT1, typename TT2>
-    auto exchange(std::pair<TT1, TT2> new_val, std::memory_order order) -> std::pair<T1, T2>
+    template<std::memory_order Order>
+    auto store(T* val) noexcept -> void
     {
-        return exchange(new_val.first, new_val.second, order);
+        static_assert(Order != std::memory_order_consume && Order != std::memory_order_acquire,
+                      "acquire on store?!");
+        ops::store<Order>(this->addr(), to_word(val));
     }
 
-    template<typename TT1, typename TT2>
-    auto exchange(TT1 new_val1, TT2 new_val2, std::memory_order order) -> std::pair<T1, T2>
+    auto store(T* val, std::memory_order order) -> void
     {
-        auto val = load(order);
-        while(true) {
-            if(compare_exchange_strong(val, new_val1, new_val2, order, std::memory_order_relaxed)){
-                return val;
-            }
+        switch(order) {
+        case std::memory_order_relaxed: store<std::memory_order_relaxed>(val); break;
+        case std::memory_order_consume:
+        case std::memory_order_acquire: assert(false && "acquire on store?!");
+        case std::memory_order_release: store<std::memory_order_release>(val); break;
+        case std::memory_order_acq_rel:
+        case std::memory_order_seq_cst: store<std::memory_order_seq_cst>(val); break;
         }
     }
 
-    template<typename TT1, typename TT2>
-    auto compare_exchange_strong(T1& old_val1,
-                                 T2& old_val2,
-                                 TT1 new_val1,
-                                 TT2 new_val2,
+    auto compare_exchange_strong(T*& old_val,
+                                 T* new_val,
                                  std::memory_order success,
                                  std::memory_order failure = std::memory_order_relaxed) noexcept
         -> bool
     {
-        auto res = 0;
-        AO_t ov1;
-        AO_t ov2;
-        AO_t nv1;
-        AO_t nv2;
-        if constexpr(std::is_pointer_v<T1>) {
-            ov1 = reinterpret_cast<AO_t>(old_val1);
-            nv1 = reinterpret_cast<AO_t>(new_val1);
-        }
-        else {
-            ov1 = static_cast<AO_t>(old_val1);
-            nv1 = static_cast<AO_t>(new_val1);
-        }
-        if constexpr(std::is_pointer_v<T2>) {
-            ov2 = reinterpret_cast<AO_t>(old_val2);
-            nv2 = reinterpret_cast<AO_t>(new_val2);
-        }
-        else {
-            ov2 = static_cast<AO_t>(old_val2);
-            nv2 = static_cast<AO_t>(new_val2);
+        const auto expected = to_word(old_val);
+        const auto fetched = detail::with_order(cas_order(success, failure), [&](auto order) {
+            return ops::fetch_compare_and_swap<decltype(order)::value>(
+                this->addr(), expected, to_word(new_val));
+        });
+        if(fetched == expected) {
+            return true;
         }
+        old_val = to_pointer(fetched);
+        return false;
+    }
 
-        if(success >= std::memory_order_acquire) {
-            AO_nop_read();
-        }
+    auto compare_exchange_weak(T*& old_val,
+                               T* new_val,
+                               std::memory_order success,
+                               std::memory_order failure = std::memory_order_relaxed) noexcept
+        -> bool
+    {
+        return compare_exchange_strong(old_val, new_val, success, failure);
+    }
 
-        if(success == std::memory_order_relaxed) {
-            res = AO_compare_double_and_swap_double(&value_, ov1, ov2, nv1, nv2);
+    // The offset is scaled by sizeof(T), as for built-in pointer arithmetic,
+    // and applied with a single AO_fetch_and_add.
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_add(std::ptrdiff_t arg) noexcept -> T*
+    {
+        const auto incr = static_cast<AO_t>(arg) * static_cast<AO_t>(sizeof(T));
+        if constexpr(ops::have_fetch_and_add) {
+            return to_pointer(ops::fetch_and_add<Order>(this->addr(), incr));
         }
         else {
-            res = AO_compare_double_and_swap_double_full(&value_, ov1, ov2, nv1, nv2);
+            auto old_val = ops::load<std::memory_order_relaxed>(this->addr());
+            for(;;) {
+                const auto fetched =
+                    ops::fetch_compare_and_swap<Order>(this->addr(), old_val, old_val + incr);
+                if(fetched == old_val) {
+                    return to_pointer(old_val);
+                }
+                old_val = fetched;
+            }
         }
+    }
 
-        if(success >= std::memory_order_release) {
-            AO_nop_write();
-        }
+    auto fetch_add(std::ptrdiff_t arg, std::memory_order order) noexcept -> T*
+    {
+        return detail::with_order(order, [&](auto o) { return fetch_add<decltype(o)::value>(arg); });
+    }
 
-        if(res) {
-            return true;
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto fetch_sub(std::ptrdiff_t arg) noexcept -> T*
+    {
+        return fetch_add<Order>(-arg);
+    }
+
+    auto fetch_sub(std::ptrdiff_t arg, std::memory_order order) noexcept -> T*
+    {
+        return detail::with_order(order, [&](auto o) { return fetch_sub<decltype(o)::value>(arg); });
+    }
+
+    auto operator++() noexcept -> T* { return fetch_add(1) + 1; }
+    auto operator++(int) noexcept -> T* { return fetch_add(1); }
+    auto operator--() noexcept -> T* { return fetch_sub(1) - 1; }
+    auto operator--(int) noexcept -> T* { return fetch_sub(1); }
+    auto operator+=(std::ptrdiff_t arg) noexcept -> T* { return fetch_add(arg) + arg; }
+    auto operator-=(std::ptrdiff_t arg) noexcept -> T* { return fetch_sub(arg) - arg; }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto wait(T* old) const noexcept -> void
+    {
+        static_assert(Order != std::memory_order_release, "release on load?!");
+        const auto expected = to_word(old);
+        detail::wait_until(this->addr(), expected, [this, expected] {
+            return ops::load<Order>(this->addr()) != expected;
+        });
+    }
+
+    auto wait(T* old, std::memory_order order) const noexcept -> void
+    {
+        switch(order) {
+        case std::memory_order_relaxed: wait<std::memory_order_relaxed>(old); break;
+        case std::memory_order_consume:
+        case std::memory_order_acquire: wait<std::memory_order_acquire>(old); break;
+        case std::memory_order_release: assert(false && "release on load?!");
+        case std::memory_order_acq_rel:
+        case std::memory_order_seq_cst: wait<std::memory_order_seq_cst>(old); break;
         }
+    }
 
-        auto load_on_failure = load(failure);
-        old_val1 = load_on_failure.first;
-        old_val2 = load_on_failure.second;
-        return false;
+    auto notify_one() noexcept -> void { detail::notify(this->addr(), false); }
+    auto notify_all() noexcept -> void { detail::notify(this->addr(), true); }
+
+private:
+    static auto to_word(T* val) noexcept -> AO_t { return reinterpret_cast<AO_t>(val); }
+    static auto to_pointer(AO_t val) noexcept -> T* { return reinterpret_cast<T*>(val); }
+
+};
+
+#if defined(AO_HAVE_double_t)
+template<typename T, template<typename> class Storage>
+class basic_atomic<T, Storage, true> : private basic_datomic<AO_t, AO_t, Storage>
+{
+    static_assert(std::is_trivially_copyable_v<T>, "ao::atomic<T> requires a trivially copyable type");
+    static_assert(sizeof(T) <= sizeof(AO_double_t), "ao::atomic<T> supports at most two words");
+
+    using words = basic_datomic<AO_t, AO_t, Storage>;
+
+protected:
+    basic_atomic() = default;
+    explicit basic_atomic(T val) noexcept : words(to_words(val).first, to_words(val).second) {}
+    explicit basic_atomic(T* obj) noexcept : words(reinterpret_cast<AO_double_t*>(obj))
+    {
+        static_assert(sizeof(T) == sizeof(AO_double_t), "no AO primitives for this size");
     }
 
-    template<typename TT1, typename TT2>
-    auto compare_exchange_strong(std::pair<T1, T2>& old_val,
-                                 TT1 new_val1,
-                                 TT2 new_val2,
+public:
+    static constexpr bool is_always_lock_free = double_lock_free;
+
+    template<std::memory_order Order>
+    auto load() const noexcept -> T
+    {
+        return from_words(words::template load<Order>());
+    }
+
+    auto load(std::memory_order order) const -> T { return from_words(words::load(order)); }
+
+    template<std::memory_order Order>
+    auto store(T val) noexcept -> void
+    {
+        const auto w = to_words(val);
+        words::template store<Order>(w.first, w.second);
+    }
+
+    auto store(T val, std::memory_order order) -> void
+    {
+        const auto w = to_words(val);
+        words::store(w.first, w.second, order);
+    }
+
+    auto exchange(T val, std::memory_order order = std::memory_order_seq_cst) -> T
+    {
+        const auto w = to_words(val);
+        return from_words(words::exchange(w.first, w.second, order));
+    }
+
+    auto compare_exchange_strong(T& old_val,
+                                 T new_val,
                                  std::memory_order success,
                                  std::memory_order failure = std::memory_order_relaxed) noexcept
         -> bool
     {
-        return compare_exchange_strong(old_val.first, old_val.second, new_val1, new_val2, success, failure);
+        auto old_w = to_words(old_val);
+        const auto new_w = to_words(new_val);
+        if(words::compare_exchange_strong(old_w, new_w.first, new_w.second, success, failure)) {
+            return true;
+        }
+        old_val = from_words(old_w);
+        return false;
     }
 
-    template<typename TT1, typename TT2>
-    auto compare_exchange_strong(std::pair<T1, T2>& old_val,
-                                 std::pair<TT1, TT2> new_val,
-                                 std::memory_order success,
-                                 std::memory_order failure = std::memory_order_relaxed) noexcept
+    auto compare_exchange_weak(T& old_val,
+                               T new_val,
+                               std::memory_order success,
+                               std::memory_order failure = std::memory_order_relaxed) noexcept
         -> bool
     {
-        return compare_exchange_strong(old_val, new_val.first, new_val.second, success, failure);
+        return compare_exchange_strong(old_val, new_val, success, failure);
     }
-private:
 
-    constexpr static auto to_pair(AO_double_t value) noexcept -> std::pair<T1, T2>
+    // Two-word values always park on the epoch of their wait slot.
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto wait(T old) const noexcept -> void
     {
-        std::pair<T1, T2> out;
-        if constexpr(std::is_pointer_v<T1>) {
-            out.first = reinterpret_cast<T1>(value.AO_parts.AO_v1);
-        }
-        else {
-            out.first = static_cast<T1>(value.AO_parts.AO_v1);
-        }
+        static_assert(Order != std::memory_order_release, "release on load?!");
+        const auto w = to_words(old);
+        AO_double_t expected{};
+        expected.AO_val1 = w.first;
+        expected.AO_val2 = w.second;
+        detail::wait_until(this->addr(), expected, [this, w] {
+            return words::template load<Order>() != w;
+        });
+    }
 
-        if constexpr(std::is_pointer_v<T2>) {
-            out.second = reinterpret_cast<T2>(value.AO_parts.AO_v2);
-        }
-        else {
-            out.second = static_cast<T2>(value.AO_parts.AO_v2);
+    auto wait(T old, std::memory_order order) const noexcept -> void
+    {
+        switch(order) {
+        case std::memory_order_relaxed: wait<std::memory_order_relaxed>(old); break;
+        case std::memory_order_consume:
+        case std::memory_order_acquire: wait<std::memory_order_acquire>(old); break;
+        case std::memory_order_release: assert(false && "release on load?!");
+        case std::memory_order_acq_rel:
+        case std::memory_order_seq_cst: wait<std::memory_order_seq_cst>(old); break;
         }
-
-        return out;
     }
 
+    auto notify_one() noexcept -> void { detail::notify(this->addr(), false); }
+    auto notify_all() noexcept -> void { detail::notify(this->addr(), true); }
+
 private:
-    AO_double_t value_;
+    static auto to_words(T val) noexcept -> std::pair<AO_t, AO_t>
+    {
+        AO_t w[2] = {0, 0};
+        std::memcpy(w, &val, sizeof(T));
+        return {w[0], w[1]};
+    }
 
+    static auto from_words(std::pair<AO_t, AO_t> w) noexcept -> T
+    {
+        const AO_t raw[2] = {w.first, w.second};
+        T out;
+        std::memcpy(&out, raw, sizeof(T));
+        return out;
+    }
 };
+#endif // AO_HAVE_double_t
 
-
-
-
+} // namespace detail
 
 template<typename T>
-class atomic
+class atomic : public detail::basic_atomic<T, detail::inline_storage>
 {
+    using base = detail::basic_atomic<T, detail::inline_storage>;
+
 public:
     atomic() = default;
 
-    atomic(T initial_value) : value_(initial_value) {}
+    constexpr atomic(T initial_value) : base(initial_value) {}
 
     ~atomic() = default;
 
@@ -222,77 +1728,134 @@ public:
     auto operator=(const atomic&) -> atomic& = default;
     atomic(atomic&&) noexcept = default;
     auto operator=(atomic&&) noexcept -> atomic& = default;
+};
 
-    auto load(std::memory_order order) const -> T
+// The ao::atomic operations applied to a caller-owned object, which has to
+// be aligned to its size.
+template<typename T>
+class atomic_ref : public detail::basic_atomic<T, detail::ref_storage>
+{
+    using base = detail::basic_atomic<T, detail::ref_storage>;
+
+public:
+    explicit atomic_ref(T& obj) noexcept : base(&obj) {}
+};
+
+class atomic_flag
+{
+    using ops = detail::ts_ops;
+
+public:
+    atomic_flag() = default;
+    ~atomic_flag() = default;
+
+    atomic_flag(const atomic_flag&) = delete;
+    auto operator=(const atomic_flag&) -> atomic_flag& = delete;
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto test_and_set() noexcept -> bool
     {
-        switch(order) {
-        case std::memory_order_relaxed: return AO_load(&value_);
-        case std::memory_order_consume:
-        case std::memory_order_acquire: return AO_load_acquire(&value_);
-        case std::memory_order_release: assert(false && "release on load?!");
-        case std::memory_order_acq_rel:
-        case std::memory_order_seq_cst: return AO_load_full(&value_); break;
+        if constexpr(Order == std::memory_order_relaxed) {
+            return AO_test_and_set(&flag_) == AO_TS_SET;
+        }
+        else if constexpr(Order == std::memory_order_consume || Order == std::memory_order_acquire) {
+            return AO_test_and_set_acquire(&flag_) == AO_TS_SET;
+        }
+        else if constexpr(Order == std::memory_order_release) {
+            return AO_test_and_set_release(&flag_) == AO_TS_SET;
+        }
+        else {
+            return AO_test_and_set_full(&flag_) == AO_TS_SET;
         }
-        return {};
     }
 
-    template<typename TT>
-    auto store(TT&& val, std::memory_order order) -> void
+    auto test_and_set(std::memory_order order) noexcept -> bool
     {
-        switch(order) {
-        case std::memory_order_relaxed: AO_store(&value_, val);
-        case std::memory_order_consume:
-        case std::memory_order_acquire: assert(false && "acquire on store?!");
-        case std::memory_order_release: AO_store_release(&value_, val);
-        case std::memory_order_acq_rel:
-        case std::memory_order_seq_cst: AO_store_full(&value_, val); break;
-        }
+        return detail::with_order(order, [&](auto o) { return test_and_set<decltype(o)::value>(); });
     }
 
-    auto compare_exchange_strong(T& old_val,
-                                 T new_val,
-                                 std::memory_order success,
-                                 std::memory_order failure = std::memory_order_relaxed) noexcept
-        -> bool
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto test() const noexcept -> bool
     {
-        switch(success) {
-        case std::memory_order_relaxed:
-            if(AO_compare_and_swap(&value_, old_val, new_val)) {
-                return true;
-            } else {
-                old_val = load(failure);
-                return false;
-            }
-        case std::memory_order_consume:
-        case std::memory_order_acquire:
-            if(AO_compare_and_swap_acquire(&value_, old_val, new_val)) {
-                return true;
-            } else {
-                old_val = load(failure);
-                return false;
-            }
-        case std::memory_order_release:
-            if(AO_compare_and_swap_release(&value_, old_val, new_val)) {
-                return true;
-            } else {
-                old_val = load(failure);
-                return false;
-            }
-        case std::memory_order_acq_rel:
-        case std::memory_order_seq_cst:
-            if(AO_compare_and_swap_full(&value_, old_val, new_val)) {
-                return true;
-            } else {
-                old_val = load(failure);
-                return false;
-            }
-            break;
+        static_assert(Order != std::memory_order_release, "release on load?!");
+        return ops::template load<Order>(&flag_) == AO_TS_SET;
+    }
+
+    template<std::memory_order Order = std::memory_order_seq_cst>
+    auto clear() noexcept -> void
+    {
+        static_assert(Order != std::memory_order_consume && Order != std::memory_order_acquire,
+                      "acquire on store?!");
+        ops::template store<Order>(&flag_, AO_TS_CLEAR);
+    }
+
+private:
+    AO_TS_t flag_ = AO_TS_INITIALIZER;
+};
+
+// Test-and-test-and-set lock, usable with std::lock_guard and friends.
+// Waiters spin on a plain load, so the line stays shared while the lock is
+// held, and back off exponentially through AO_pause() between attempts.
+class spinlock
+{
+public:
+    spinlock() = default;
+    ~spinlock() = default;
+
+    spinlock(const spinlock&) = delete;
+    auto operator=(const spinlock&) -> spinlock& = delete;
+
+    auto lock() noexcept -> void
+    {
+        if(AO_EXPECT_FALSE(!try_lock())) {
+            lock_contended();
         }
-        return false;
     }
 
+    auto try_lock() noexcept -> bool { return !flag_.test_and_set<std::memory_order_acquire>(); }
+
+    auto unlock() noexcept -> void { flag_.clear<std::memory_order_release>(); }
+
 private:
-    AO_t value_ = 0;
+    // AO_pause(n) spins for 2**n units below 12 and sleeps beyond that, so
+    // the back-off is capped below that threshold: a contended lock keeps
+    // polling (with pauses of up to 2**11 units) instead of sleeping.
+    static constexpr int max_backoff = 11;
+
+    auto lock_contended() noexcept -> void
+    {
+        int backoff = 0;
+        do {
+            while(flag_.test<std::memory_order_relaxed>()) {
+                AO_pause(backoff < max_backoff ? ++backoff : backoff);
+            }
+        } while(!try_lock());
+    }
+
+    atomic_flag flag_;
+};
+
+// Destructive interference size of the target, see AO_CACHE_LINE_SIZE.
+inline constexpr std::size_t cacheline_size = AO_CACHE_LINE_SIZE;
+
+// Gives a T a cache line (or several) of its own, so that writes to its
+// neighbours in an array or struct do not invalidate it.
+template<typename T>
+struct alignas(cacheline_size) padded
+{
+    T value;
+
+    auto operator*() noexcept -> T& { return value; }
+    auto operator*() const noexcept -> const T& { return value; }
+    auto operator->() noexcept -> T* { return &value; }
+    auto operator->() const noexcept -> const T* { return &value; }
+};
+
+template<typename T>
+class alignas(cacheline_size) cacheline_atomic : public atomic<T>
+{
+public:
+    using atomic<T>::atomic;
 };
 
-} // namespace AO
\ No newline at end of file
+} // namespace AO
@@ -138,11 +138,18 @@ AO_API void AO_store_full_emulation(volatile AO_t *addr, AO_t val);
 
 #define AO_HASH(x) ((unsigned)((AO_uintptr_t)(x) >> 12) & (AO_HASH_SIZE-1))
 
-static AO_TS_t AO_locks[AO_HASH_SIZE] = {
-  AO_TS_INITIALIZER, AO_TS_INITIALIZER, AO_TS_INITIALIZER, AO_TS_INITIALIZER,
-  AO_TS_INITIALIZER, AO_TS_INITIALIZER, AO_TS_INITIALIZER, AO_TS_INITIALIZER,
-  AO_TS_INITIALIZER, AO_TS_INITIALIZER, AO_TS_INITIALIZER, AO_TS_INITIALIZER,
-  AO_TS_INITIALIZER, AO_TS_INITIALIZER, AO_TS_INITIALIZER, AO_TS_INITIALIZER,
+/* Each lock gets a cache line of its own, so that spinning on one     */
+/* does not slow down the holders of the others.                        */
+static union {
+  AO_TS_t lock;
+  char pad[AO_CACHE_LINE_SIZE];
+} AO_locks[AO_HASH_SIZE] = {
+  { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER },
+  { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER },
+  { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER },
+  { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER },
+  { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER }, { AO_TS_INITIALIZER },
+  { AO_TS_INITIALIZER }
 };
 
 static void lock_ool(volatile AO_TS_t *l)
@@ -193,7 +200,7 @@ AO_INLINE void unlock(volatile AO_TS_t *l)
 AO_API AO_t AO_fetch_compare_and_swap_emulation(volatile AO_t *addr,
                                                 AO_t old_val, AO_t new_val)
 {
-  AO_TS_t *my_lock = AO_locks + AO_HASH(addr);
+  AO_TS_t *my_lock = &AO_locks[AO_HASH(addr)].lock;
   AO_t fetched_val;
 
 # ifndef AO_USE_NO_SIGNALS
@@ -216,7 +223,7 @@ AO_compare_double_and_swap_double_emulation(volatile AO_double_t *addr,
                                             AO_t old_val1, AO_t old_val2,
                                             AO_t new_val1, AO_t new_val2)
 {
-  AO_TS_t *my_lock = AO_locks + AO_HASH(addr);
+  AO_TS_t *my_lock = &AO_locks[AO_HASH(addr)].lock;
   int result;
 
 # ifndef AO_USE_NO_SIGNALS
@@ -241,7 +248,7 @@ AO_compare_double_and_swap_double_emulation(volatile AO_double_t *addr,
 
 AO_API void AO_store_full_emulation(volatile AO_t *addr, AO_t val)
 {
-  AO_TS_t *my_lock = AO_locks + AO_HASH(addr);
+  AO_TS_t *my_lock = &AO_locks[AO_HASH(addr)].lock;
   lock(my_lock);
   *addr = val;
   unlock(my_lock);
@@ -298,3 +305,19 @@ AO_API void AO_pause(int n)
 #   endif
   }
 }
+
+/* The slots that the C++ ao::atomic wait/notify (see atomic.hpp) park  */
+/* on: an epoch and a count of the waiters each.  The table is kept     */
+/* here, so that every module of a process uses the same one, and each  */
+/* slot gets a cache line of its own, like the AO_locks above.          */
+#define AO_WAIT_SLOTS 16
+
+static union {
+  unsigned slot[2];
+  char pad[AO_CACHE_LINE_SIZE];
+} AO_wait_table[AO_WAIT_SLOTS];
+
+AO_API unsigned *AO_wait_slot(const volatile void *addr)
+{
+  return AO_wait_table[((AO_uintptr_t)addr >> 6) % AO_WAIT_SLOTS].slot;
+}
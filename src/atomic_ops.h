@@ -289,6 +289,18 @@ struct AO_uintptr_t_size_static_assert {
     assert(((AO_uintptr_t)(addr) & (sizeof(*(addr)) - 1)) == 0)
 #endif /* !AO_ALIGNOF_SUPPORTED */
 
+#ifndef AO_CACHE_LINE_SIZE
+  /* The destructive interference size: independently updated hot data  */
+  /* should be kept at least this far apart to avoid false sharing.     */
+  /* The 128-byte targets prefetch or transfer adjacent lines in pairs. */
+# if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) \
+     || defined(_M_ARM64) || defined(__powerpc64__) || defined(__ppc64__)
+#   define AO_CACHE_LINE_SIZE 128
+# else
+#   define AO_CACHE_LINE_SIZE 64
+# endif
+#endif /* !AO_CACHE_LINE_SIZE */
+
 #if defined(__GNUC__) && !defined(__INTEL_COMPILER)
 # define AO_compiler_barrier() __asm__ __volatile__("" : : : "memory")
 #elif defined(_MSC_VER) || defined(__DMC__) || defined(__BORLANDC__) \
@@ -523,6 +535,16 @@ struct AO_uintptr_t_size_static_assert {
 # include "atomic_ops/generalize.h"
 #endif
 
+/* For internal use only: the wait slot (an epoch and a count of the   */
+/* waiters) of addr for the C++ ao::atomic wait/notify (atomic.hpp).   */
+#ifdef __cplusplus
+  extern "C" {
+#endif
+AO_API unsigned *AO_wait_slot(const volatile void * /* addr */);
+#ifdef __cplusplus
+  } /* extern "C" */
+#endif
+
 /* For compatibility with version 0.4 and earlier       */
 #define AO_TS_T AO_TS_t
 #define AO_T AO_t
@@ -727,3 +727,110 @@
 #   define AO_HAVE_double_compare_and_swap_dd_acquire_read
 # endif /* !AO_NO_DD_ORDERING */
 #endif
+
+/* Fetch_compare_double_and_swap_double */
+#if defined(AO_HAVE_fetch_compare_double_and_swap_double_full)
+# if !defined(AO_HAVE_fetch_compare_double_and_swap_double_release)
+#   define AO_fetch_compare_double_and_swap_double_release(addr,o1,o2,n1,n2) \
+            AO_fetch_compare_double_and_swap_double_full(addr,o1,o2,n1,n2)
+#   define AO_HAVE_fetch_compare_double_and_swap_double_release
+# endif
+# if !defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire)
+#   define AO_fetch_compare_double_and_swap_double_acquire(addr,o1,o2,n1,n2) \
+            AO_fetch_compare_double_and_swap_double_full(addr,o1,o2,n1,n2)
+#   define AO_HAVE_fetch_compare_double_and_swap_double_acquire
+# endif
+#endif /* AO_HAVE_fetch_compare_double_and_swap_double_full */
+
+#if !defined(AO_HAVE_fetch_compare_double_and_swap_double) \
+    && defined(AO_HAVE_fetch_compare_double_and_swap_double_release)
+# define AO_fetch_compare_double_and_swap_double(addr,o1,o2,n1,n2) \
+            AO_fetch_compare_double_and_swap_double_release(addr,o1,o2,n1,n2)
+# define AO_HAVE_fetch_compare_double_and_swap_double
+#endif
+#if !defined(AO_HAVE_fetch_compare_double_and_swap_double) \
+    && defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire)
+# define AO_fetch_compare_double_and_swap_double(addr,o1,o2,n1,n2) \
+            AO_fetch_compare_double_and_swap_double_acquire(addr,o1,o2,n1,n2)
+# define AO_HAVE_fetch_compare_double_and_swap_double
+#endif
+
+/* Emulate the remaining fetch_compare_double_and_swap_double variants  */
+/* by a double_load followed by compare_double_and_swap_double; the     */
+/* loaded value is returned if it differs from the expected one.        */
+#if defined(AO_HAVE_compare_double_and_swap_double) \
+    && defined(AO_HAVE_double_load) \
+    && !defined(AO_HAVE_fetch_compare_double_and_swap_double)
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double(volatile AO_double_t *addr,
+                                AO_t o1, AO_t o2, AO_t n1, AO_t n2)
+  {
+    AO_double_t fetched;
+
+    do {
+      fetched = AO_double_load(addr);
+      if (fetched.AO_val1 != o1 || fetched.AO_val2 != o2)
+        break;
+    } while (AO_EXPECT_FALSE(!AO_compare_double_and_swap_double(addr,
+                                                        o1, o2, n1, n2)));
+    return fetched;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double
+#endif
+#if defined(AO_HAVE_compare_double_and_swap_double_acquire) \
+    && defined(AO_HAVE_double_load_acquire) \
+    && !defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire)
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double_acquire(volatile AO_double_t *addr,
+                                AO_t o1, AO_t o2, AO_t n1, AO_t n2)
+  {
+    AO_double_t fetched;
+
+    do {
+      fetched = AO_double_load_acquire(addr);
+      if (fetched.AO_val1 != o1 || fetched.AO_val2 != o2)
+        break;
+    } while (AO_EXPECT_FALSE(!AO_compare_double_and_swap_double_acquire(addr,
+                                                        o1, o2, n1, n2)));
+    return fetched;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double_acquire
+#endif
+#if defined(AO_HAVE_compare_double_and_swap_double_release) \
+    && defined(AO_HAVE_double_load) \
+    && !defined(AO_HAVE_fetch_compare_double_and_swap_double_release)
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double_release(volatile AO_double_t *addr,
+                                AO_t o1, AO_t o2, AO_t n1, AO_t n2)
+  {
+    AO_double_t fetched;
+
+    do {
+      fetched = AO_double_load(addr);
+      if (fetched.AO_val1 != o1 || fetched.AO_val2 != o2)
+        break;
+    } while (AO_EXPECT_FALSE(!AO_compare_double_and_swap_double_release(addr,
+                                                        o1, o2, n1, n2)));
+    return fetched;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double_release
+#endif
+#if defined(AO_HAVE_compare_double_and_swap_double_full) \
+    && defined(AO_HAVE_double_load_acquire) \
+    && !defined(AO_HAVE_fetch_compare_double_and_swap_double_full)
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double_full(volatile AO_double_t *addr,
+                                AO_t o1, AO_t o2, AO_t n1, AO_t n2)
+  {
+    AO_double_t fetched;
+
+    do {
+      fetched = AO_double_load_acquire(addr);
+      if (fetched.AO_val1 != o1 || fetched.AO_val2 != o2)
+        break;
+    } while (AO_EXPECT_FALSE(!AO_compare_double_and_swap_double_full(addr,
+                                                        o1, o2, n1, n2)));
+    return fetched;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double_full
+#endif
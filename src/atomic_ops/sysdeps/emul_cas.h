@@ -43,6 +43,9 @@
 # include "standard_ao_double_t.h"
 #endif
 
+/* Tells clients that CAS (and what is built on it) takes a lock.       */
+#define AO_EMULATED_CAS
+
 #ifdef __cplusplus
   extern "C" {
 #endif
@@ -69,6 +72,7 @@ AO_API void AO_store_full_emulation(volatile AO_t *addr, AO_t val);
         AO_compare_double_and_swap_double_emulation(addr, old1, old2, \
                                                     newval1, newval2)
 # define AO_HAVE_compare_double_and_swap_double_full
+# define AO_EMULATED_DOUBLE_CAS
 #endif
 
 #undef AO_store
@@ -261,6 +261,136 @@
   }
 # define AO_HAVE_double_compare_and_swap_full
 
+  /* The same as the above but return the value observed by the load    */
+  /* (equal to the old one on success).                                 */
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double(volatile AO_double_t *addr,
+                                          AO_t old_val1, AO_t old_val2,
+                                          AO_t new_val1, AO_t new_val2)
+  {
+    AO_double_t tmp;
+    int result = 1;
+
+    do {
+      __asm__ __volatile__("//AO_fetch_compare_double_and_swap_double\n"
+#       ifdef __ILP32__
+          "       ldxp  %w0, %w1, %2\n"
+#       else
+          "       ldxp  %0, %1, %2\n"
+#       endif
+        : "=&r" (tmp.AO_val1), "=&r" (tmp.AO_val2)
+        : "Q" (*addr));
+      if (tmp.AO_val1 != old_val1 || tmp.AO_val2 != old_val2)
+        break;
+      __asm__ __volatile__(
+#       ifdef __ILP32__
+          "       stxp %w0, %w2, %w3, %1\n"
+#       else
+          "       stxp %w0, %2, %3, %1\n"
+#       endif
+        : "=&r" (result), "=Q" (*addr)
+        : "r" (new_val1), "r" (new_val2));
+    } while (AO_EXPECT_FALSE(result));
+    return tmp;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double
+
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double_acquire(volatile AO_double_t *addr,
+                                                  AO_t old_val1, AO_t old_val2,
+                                                  AO_t new_val1, AO_t new_val2)
+  {
+    AO_double_t tmp;
+    int result = 1;
+
+    do {
+      __asm__ __volatile__("//AO_fetch_compare_double_and_swap_double_acquire\n"
+#       ifdef __ILP32__
+          "       ldaxp  %w0, %w1, %2\n"
+#       else
+          "       ldaxp  %0, %1, %2\n"
+#       endif
+        : "=&r" (tmp.AO_val1), "=&r" (tmp.AO_val2)
+        : "Q" (*addr));
+      if (tmp.AO_val1 != old_val1 || tmp.AO_val2 != old_val2)
+        break;
+      __asm__ __volatile__(
+#       ifdef __ILP32__
+          "       stxp %w0, %w2, %w3, %1\n"
+#       else
+          "       stxp %w0, %2, %3, %1\n"
+#       endif
+        : "=&r" (result), "=Q" (*addr)
+        : "r" (new_val1), "r" (new_val2));
+    } while (AO_EXPECT_FALSE(result));
+    return tmp;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double_acquire
+
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double_release(volatile AO_double_t *addr,
+                                                  AO_t old_val1, AO_t old_val2,
+                                                  AO_t new_val1, AO_t new_val2)
+  {
+    AO_double_t tmp;
+    int result = 1;
+
+    do {
+      __asm__ __volatile__("//AO_fetch_compare_double_and_swap_double_release\n"
+#       ifdef __ILP32__
+          "       ldxp  %w0, %w1, %2\n"
+#       else
+          "       ldxp  %0, %1, %2\n"
+#       endif
+        : "=&r" (tmp.AO_val1), "=&r" (tmp.AO_val2)
+        : "Q" (*addr));
+      if (tmp.AO_val1 != old_val1 || tmp.AO_val2 != old_val2)
+        break;
+      __asm__ __volatile__(
+#       ifdef __ILP32__
+          "       stlxp %w0, %w2, %w3, %1\n"
+#       else
+          "       stlxp %w0, %2, %3, %1\n"
+#       endif
+        : "=&r" (result), "=Q" (*addr)
+        : "r" (new_val1), "r" (new_val2));
+    } while (AO_EXPECT_FALSE(result));
+    return tmp;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double_release
+
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double_full(volatile AO_double_t *addr,
+                                               AO_t old_val1, AO_t old_val2,
+                                               AO_t new_val1, AO_t new_val2)
+  {
+    AO_double_t tmp;
+    int result = 1;
+
+    do {
+      __asm__ __volatile__("//AO_fetch_compare_double_and_swap_double_full\n"
+#       ifdef __ILP32__
+          "       ldaxp  %w0, %w1, %2\n"
+#       else
+          "       ldaxp  %0, %1, %2\n"
+#       endif
+        : "=&r" (tmp.AO_val1), "=&r" (tmp.AO_val2)
+        : "Q" (*addr));
+      if (tmp.AO_val1 != old_val1 || tmp.AO_val2 != old_val2)
+        break;
+      __asm__ __volatile__(
+#       ifdef __ILP32__
+          "       stlxp %w0, %w2, %w3, %1\n"
+#       else
+          "       stlxp %w0, %2, %3, %1\n"
+#       endif
+        : "=&r" (result), "=Q" (*addr)
+        : "r" (new_val1), "r" (new_val2));
+    } while (AO_EXPECT_FALSE(result));
+    return tmp;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double_full
+
 #endif /* !__ILP32__ && !__clang__ || AO_AARCH64_ASM_LOAD_STORE_CAS */
 
 /* As of clang-5.0 and gcc-8.1, __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16     */
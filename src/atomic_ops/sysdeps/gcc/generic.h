@@ -244,4 +244,102 @@
     }
 #   define AO_HAVE_double_compare_and_swap_full
 # endif
+
+  /* The fetch_ variants return the value observed by the CAS (which    */
+  /* is old_val on success), so a failure needs no separate reload.     */
+  /* Not for AArch64, where this builtin is not lock-free (and so is    */
+  /* not atomic against the asm-based double-word primitives).          */
+# ifndef __aarch64__
+# ifndef AO_HAVE_fetch_compare_double_and_swap_double
+    AO_INLINE AO_double_t
+    AO_fetch_compare_double_and_swap_double(
+                                volatile AO_double_t *addr,
+                                AO_t old_val1, AO_t old_val2,
+                                AO_t new_val1, AO_t new_val2)
+    {
+      AO_double_t old_w;
+      AO_double_t new_w;
+
+      old_w.AO_val1 = old_val1;
+      old_w.AO_val2 = old_val2;
+      new_w.AO_val1 = new_val1;
+      new_w.AO_val2 = new_val2;
+      (void)__atomic_compare_exchange_n(&addr->AO_whole, &old_w.AO_whole,
+                                        new_w.AO_whole, 0,
+                                        __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED);
+      return old_w;
+    }
+#   define AO_HAVE_fetch_compare_double_and_swap_double
+# endif
+
+# ifndef AO_HAVE_fetch_compare_double_and_swap_double_acquire
+    AO_INLINE AO_double_t
+    AO_fetch_compare_double_and_swap_double_acquire(
+                                volatile AO_double_t *addr,
+                                AO_t old_val1, AO_t old_val2,
+                                AO_t new_val1, AO_t new_val2)
+    {
+      AO_double_t old_w;
+      AO_double_t new_w;
+
+      old_w.AO_val1 = old_val1;
+      old_w.AO_val2 = old_val2;
+      new_w.AO_val1 = new_val1;
+      new_w.AO_val2 = new_val2;
+      (void)__atomic_compare_exchange_n(&addr->AO_whole, &old_w.AO_whole,
+                                        new_w.AO_whole, 0,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE);
+      return old_w;
+    }
+#   define AO_HAVE_fetch_compare_double_and_swap_double_acquire
+# endif
+
+# ifndef AO_HAVE_fetch_compare_double_and_swap_double_release
+    AO_INLINE AO_double_t
+    AO_fetch_compare_double_and_swap_double_release(
+                                volatile AO_double_t *addr,
+                                AO_t old_val1, AO_t old_val2,
+                                AO_t new_val1, AO_t new_val2)
+    {
+      AO_double_t old_w;
+      AO_double_t new_w;
+
+      old_w.AO_val1 = old_val1;
+      old_w.AO_val2 = old_val2;
+      new_w.AO_val1 = new_val1;
+      new_w.AO_val2 = new_val2;
+      (void)__atomic_compare_exchange_n(&addr->AO_whole, &old_w.AO_whole,
+                                        new_w.AO_whole, 0,
+                                        __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED /* failure */);
+      return old_w;
+    }
+#   define AO_HAVE_fetch_compare_double_and_swap_double_release
+# endif
+
+# ifndef AO_HAVE_fetch_compare_double_and_swap_double_full
+    AO_INLINE AO_double_t
+    AO_fetch_compare_double_and_swap_double_full(
+                                volatile AO_double_t *addr,
+                                AO_t old_val1, AO_t old_val2,
+                                AO_t new_val1, AO_t new_val2)
+    {
+      AO_double_t old_w;
+      AO_double_t new_w;
+
+      old_w.AO_val1 = old_val1;
+      old_w.AO_val2 = old_val2;
+      new_w.AO_val1 = new_val1;
+      new_w.AO_val2 = new_val2;
+      (void)__atomic_compare_exchange_n(&addr->AO_whole, &old_w.AO_whole,
+                                        new_w.AO_whole, 0,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE /* failure */);
+      return old_w;
+    }
+#   define AO_HAVE_fetch_compare_double_and_swap_double_full
+# endif
+# endif /* !__aarch64__ */
 #endif /* AO_GCC_HAVE_double_SYNC_CAS */
@@ -614,8 +614,27 @@ AO_fetch_compare_and_swap_full(volatile AO_t *addr, AO_t old_val,
   }
 # define AO_HAVE_compare_double_and_swap_double_full
 
+  /* cmpxchg16b leaves the observed value in rdx:rax either way.        */
+  AO_INLINE AO_double_t
+  AO_fetch_compare_double_and_swap_double_full(volatile AO_double_t *addr,
+                                         AO_t old_val1, AO_t old_val2,
+                                         AO_t new_val1, AO_t new_val2)
+  {
+    AO_double_t result;
+
+    __asm__ __volatile__("lock; cmpxchg16b %0"
+                        : "+m" (*addr), "+d" (old_val2), "+a" (old_val1)
+                        : "c" (new_val2), "b" (new_val1)
+                        : "memory", "cc");
+    result.AO_val1 = old_val1;
+    result.AO_val2 = old_val2;
+    return result;
+  }
+# define AO_HAVE_fetch_compare_double_and_swap_double_full
+
 #elif defined(AO_WEAK_DOUBLE_CAS_EMULATION)
 # include "../standard_ao_double_t.h"
+# define AO_EMULATED_DOUBLE_CAS
 
 # ifdef __cplusplus
     extern "C" {
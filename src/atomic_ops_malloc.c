@@ -289,8 +289,17 @@ get_chunk(void)
 }
 
 /* Object free lists.  I-th entry corresponds to objects        */
-/* of total size 2**i bytes.                                    */
-static AO_stack_t AO_free_list[LOG_MAX_SIZE+1];
+/* of total size 2**i bytes.  The lists are padded to a cache   */
+/* line each, so that traffic on one size class does not        */
+/* invalidate its neighbours.                                   */
+#define AO_FREE_LIST_PAD_SIZE \
+        ((sizeof(AO_stack_t) + AO_CACHE_LINE_SIZE - 1) \
+         / AO_CACHE_LINE_SIZE * AO_CACHE_LINE_SIZE)
+
+static union {
+  AO_stack_t list;
+  char pad[AO_FREE_LIST_PAD_SIZE];
+} AO_free_list[LOG_MAX_SIZE+1];
 
 /* Break up the chunk, and add it to the object free list for   */
 /* the given size.  We have exclusive access to chunk.          */
@@ -298,16 +307,26 @@ static void add_chunk_as(void * chunk, unsigned log_sz)
 {
   size_t ofs, limit;
   size_t sz = (size_t)1 << log_sz;
+  AO_uintptr_t *first = NULL;
+  AO_uintptr_t *last = NULL;
 
   assert((size_t)CHUNK_SIZE >= sz);
   assert(sz % sizeof(AO_uintptr_t) == 0);
   limit = (size_t)CHUNK_SIZE - sz;
+  /* Link the objects privately, highest address first (the order  */
+  /* the individual pushes used to leave them in), and publish the  */
+  /* whole chain with a single CAS on the free list.                */
   for (ofs = ALIGNMENT - sizeof(AO_uintptr_t); ofs <= limit; ofs += sz) {
+    AO_uintptr_t *link = (AO_uintptr_t *)chunk + ofs / sizeof(AO_uintptr_t);
+
     ASAN_POISON_MEMORY_REGION((char *)chunk + ofs + sizeof(AO_uintptr_t),
                               sz - sizeof(AO_uintptr_t));
-    AO_stack_push(&AO_free_list[log_sz],
-                  (AO_uintptr_t *)chunk + ofs / sizeof(AO_uintptr_t));
+    *link = (AO_uintptr_t)first;
+    if (NULL == last)
+      last = link;
+    first = link;
   }
+  AO_stack_push_list(&AO_free_list[log_sz].list, first, last);
 }
 
 static const unsigned char msbs[16] = {
@@ -375,14 +394,14 @@ AO_malloc(size_t sz)
   log_sz = msb(sz + sizeof(AO_uintptr_t) - 1);
   assert(log_sz <= LOG_MAX_SIZE);
   assert(((size_t)1 << log_sz) >= sz + sizeof(AO_uintptr_t));
-  result = AO_stack_pop(AO_free_list + log_sz);
+  result = AO_stack_pop(&AO_free_list[log_sz].list);
   while (AO_EXPECT_FALSE(NULL == result)) {
     void *chunk = get_chunk();
 
     if (AO_EXPECT_FALSE(NULL == chunk))
       return NULL;
     add_chunk_as(chunk, log_sz);
-    result = AO_stack_pop(AO_free_list + log_sz);
+    result = AO_stack_pop(&AO_free_list[log_sz].list);
   }
   *result = log_sz;
 # ifdef AO_TRACE_MALLOC
@@ -413,6 +432,6 @@ AO_free(void *p)
   } else {
     ASAN_POISON_MEMORY_REGION(base + 1,
                               ((size_t)1 << log_sz) - sizeof(AO_uintptr_t));
-    AO_stack_push(AO_free_list + log_sz, base);
+    AO_stack_push(&AO_free_list[log_sz].list, base);
   }
 }
@@ -24,6 +24,19 @@
 #include <stdlib.h>
 #include <assert.h>
 
+#ifdef AO_STACK_USE_PTR_TAG
+# include <stdio.h>
+#endif
+
+#if defined(__linux__) && !defined(AO_STACK_NO_FUTEX)
+# define AO_STACK_USE_FUTEX
+# include <limits.h>
+# include <time.h>
+# include <unistd.h>
+# include <sys/syscall.h>
+# include <linux/futex.h>
+#endif
+
 #ifndef AO_BUILD
 # define AO_BUILD
 #endif
@@ -35,11 +48,34 @@
 #define AO_REQUIRE_CAS
 #include "atomic_ops_stack.h"
 
+#ifdef __cplusplus
+  extern "C" {
+#endif
+AO_API void AO_pause(int); /* defined in atomic_ops.c */
+#ifdef __cplusplus
+  } /* extern "C" */
+#endif
+
 AO_API void AO_stack_init(AO_stack_t *list)
 {
   memset(list, 0, sizeof(AO_stack_t));
 }
 
+AO_API void AO_stack_elim_init(AO_stack_elim_t *list)
+{
+  memset(list, 0, sizeof(AO_stack_elim_t));
+}
+
+AO_API void AO_sharded_stack_init(AO_sharded_stack_t *list)
+{
+  memset(list, 0, sizeof(AO_sharded_stack_t));
+}
+
+AO_API void AO_index_stack_init(AO_index_stack_t *list)
+{
+  list->AO_head = 0;
+}
+
 AO_API int AO_stack_is_lock_free(void)
 {
 # ifdef AO_USE_ALMOST_LOCK_FREE
@@ -78,16 +114,73 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
 # define store_before_cas(addr, value) (void)(*(addr) = (value))
 #endif
 
-#ifdef AO_USE_ALMOST_LOCK_FREE
+#ifdef AO_STACK_COUNT
+  /* The number of elements in a private chain from p to last (or to    */
+  /* its end if last is NULL).                                          */
+  static AO_t chain_length(AO_uintptr_t *p, const AO_uintptr_t *last)
+  {
+    AO_t n = 1;
 
-# ifdef __cplusplus
-    extern "C" {
-# endif
-  AO_API void AO_pause(int); /* defined in atomic_ops.c */
-# ifdef __cplusplus
-    } /* extern "C" */
+    while (p != last && (p = (AO_uintptr_t *)AO_REAL_NEXT_PTR(*p)) != NULL)
+      ++n;
+    return n;
+  }
+#endif
+
+/* Except in the double-word CAS implementation, the element count of  */
+/* AO_stack_t is kept in its AO_aux, which is otherwise unused and      */
+/* shares the cache line with the list head.  It is updated after the   */
+/* head, so it may lag behind (or even go transiently "negative").      */
+#ifdef AO_STACK_COUNT
+# define stack_count(list) ((volatile AO_t *)&(list)->AO_pa.AO_aux)
+# define count_add(list, n) \
+                (void)AO_fetch_and_add(stack_count(list), (AO_t)(n))
+#else
+# define count_add(list, n) (void)0
+#endif
+
+#ifdef AO_STACK_USE_FUTEX
+  /* The threads parked in AO_stack_pop_wait are counted in a small     */
+  /* table of wait slots hashed by the stack address (stacks sharing a  */
+  /* slot just cause spurious wake-ups).  The sequence number of a slot */
+  /* is the futex word; it is bumped by every wake-up.                  */
+# ifndef AO_STACK_WAIT_SLOTS
+#   define AO_STACK_WAIT_SLOTS 16
 # endif
 
+  static struct stack_wait {
+    volatile AO_t waiters;
+    volatile unsigned seq;
+  } stack_waits[AO_STACK_WAIT_SLOTS];
+
+# define WAIT_SLOT(list) \
+        (&stack_waits[((AO_uintptr_t)(list) / sizeof(AO_stack_t)) \
+                      % AO_STACK_WAIT_SLOTS])
+
+  /* Called by a push that has made the stack non-empty.  All the       */
+  /* waiters are woken since the pushes to a non-empty stack do not     */
+  /* wake anyone, so a single wake-up might leave elements behind with  */
+  /* some waiters still parked.                                         */
+  static void wake_waiters(AO_stack_t *list)
+  {
+    struct stack_wait *w = WAIT_SLOT(list);
+
+    /* Order the CAS on the head before the load of waiters; pairs with */
+    /* the full barrier in AO_stack_pop_wait.                           */
+    AO_nop_full();
+    if (AO_EXPECT_FALSE(AO_load(&w->waiters) != 0)) {
+      (void)AO_int_fetch_and_add1(&w->seq);
+      (void)syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, INT_MAX,
+                    NULL, NULL, 0);
+    }
+  }
+#else
+# define wake_waiters(list) (void)0
+#endif
+
+
+#ifdef AO_USE_ALMOST_LOCK_FREE
+
 # if defined(__alpha__) && (__GNUC__ == 4)
     /* Workaround __builtin_expect bug found in         */
     /* gcc-4.6.3/alpha causing test_stack failure.      */
@@ -121,60 +214,146 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
   /* pointer is now wrong.  Our solution is not fully lock-free, but it */
   /* is good enough for signal handlers, provided we have a suitably    */
   /* low bound on the number of recursive signal handler reentries.     */
-  /* A list consists of a first pointer and a blacklist of pointer      */
-  /* values that are currently being removed.  No list element on       */
-  /* the blacklist may be inserted.  If we would otherwise do so, we    */
+  /* A list consists of a first pointer, and there is a blacklist of    */
+  /* pointer values that are currently being removed.  No list element  */
+  /* on the blacklist may be inserted.  If we would otherwise do so, we */
   /* are allowed to insert a variant that differs only in the least     */
-  /* significant, ignored, bits.  If the list is full, we wait.         */
+  /* significant, ignored, bits.                                        */
 
   /* Crucial observation: A particular padded pointer x (i.e. pointer   */
   /* plus arbitrary low order bits) can never be newly inserted into    */
-  /* a list while it's in the corresponding auxiliary data structure.   */
+  /* a list while it's on the blacklist.                                */
 
-  /* The second argument is a pointer to the link field of the element  */
-  /* to be inserted.                                                    */
-  /* Both list headers and link fields contain "perturbed" pointers,    */
-  /* i.e. pointers with extra bits or'ed into the low order bits.       */
-  AO_API void AO_stack_push_explicit_aux_release(volatile AO_uintptr_t *list,
-                                                 AO_uintptr_t *x,
-                                                 AO_stack_aux *a)
+  /* The blacklist is a registry of hazard slots shared by all lists    */
+  /* (a stale entry of one list only costs a perturbation in another).  */
+  /* A pop claims a free slot for its duration, so there are as many    */
+  /* slots in use as there are pops in progress.  The slots come in     */
+  /* blocks; the first one is static, further ones are allocated when   */
+  /* all the slots are busy (and, in the unlikely case the allocation   */
+  /* fails, the pop waits for a slot to be freed).  Each thread starts  */
+  /* its search at its own place in a block, so that concurrent pops    */
+  /* do not all fight for the first slot.  Pushes scan only the slots   */
+  /* below the high-water mark of the claimed ones.                     */
+  /* AO_stack_aux is no longer used, it is kept for the ABI.            */
+# ifndef AO_HAZARD_BLOCK_SIZE
+#   define AO_HAZARD_BLOCK_SIZE 16
+# endif
+
+  /* The blocks are padded to whole cache lines, like the AO_locks of   */
+  /* atomic_ops.c, so that the pops do not disturb the nearby data.     */
+# define HAZARD_BLOCK_PAD_SIZE \
+        (AO_CACHE_LINE_SIZE - (AO_HAZARD_BLOCK_SIZE + 1) \
+                              * sizeof(AO_internal_ptr_t) % AO_CACHE_LINE_SIZE)
+
+  struct hazard_block {
+    AO_internal_ptr_t volatile slot[AO_HAZARD_BLOCK_SIZE];
+    AO_internal_ptr_t volatile next; /* struct hazard_block * */
+    char pad[HAZARD_BLOCK_PAD_SIZE];
+  };
+
+  static struct hazard_block hazard_slots;
+
+  /* The slots with lower indices (counted across the blocks) may be in */
+  /* use.  It never goes below AO_HAZARD_BLOCK_SIZE once there, but is  */
+  /* lowered again when the slots of the further blocks are released.   */
+  static volatile AO_t hazard_hwm = 0;
+
+  /* A value that no pushed pointer has; marks a free slot which the    */
+  /* high-water mark is being lowered past, so that it is not claimed   */
+  /* in the meantime.                                                   */
+# define HAZARD_RETIRING ((AO_internal_ptr_t)1)
+
+  /* Whether the padded pointer x_bits is on the blacklist.             */
+  static int is_blacklisted(AO_internal_ptr_t x_bits)
+  {
+    AO_t n = AO_load_acquire(&hazard_hwm);
+    const struct hazard_block *b = &hazard_slots;
+    AO_t i;
+
+    for (i = 0; i < n; ++i) {
+      if (i > 0 && i % AO_HAZARD_BLOCK_SIZE == 0)
+        b = (const struct hazard_block *)AO_cptr_load_acquire(&b->next);
+      if (AO_cptr_load(&b->slot[i % AO_HAZARD_BLOCK_SIZE]) == x_bits)
+        return 1;
+    }
+    return 0;
+  }
+
+  /* A single attempt to make first (perturbed to *px_bits if needed)   */
+  /* the top of the list, with last linked to the current top (stored   */
+  /* to *pnext too).  Fails only if the CAS on the list head does.      */
+  static int try_push_head(volatile AO_uintptr_t *list,
+                           AO_internal_ptr_t *px_bits,
+                           AO_uintptr_t *first, AO_uintptr_t *last,
+                           AO_internal_ptr_t *pnext)
   {
-    AO_internal_ptr_t x_bits = (AO_internal_ptr_t)x;
     AO_internal_ptr_t next;
 
-    /* No deletions of x can start here, since x is not         */
+    /* No deletions of first can start here, since first is not */
     /* currently in the list.                                   */
   retry:
-    do {
-      next = AO_cptr_load_acquire((AO_internal_ptr_t volatile *)list);
-      store_before_cas((AO_internal_ptr_t *)x, next);
+    next = AO_cptr_load_acquire((AO_internal_ptr_t volatile *)list);
+    store_before_cas((AO_internal_ptr_t *)last, next);
 
-      {
-#     if AO_BL_SIZE == 2
-        /* Start all loads as close to concurrently as possible.        */
-        AO_internal_ptr_t entry1 = AO_cptr_load(&a->AO_stack_bl[0]);
-        AO_internal_ptr_t entry2 = AO_cptr_load(&a->AO_stack_bl[1]);
+    if (AO_EXPECT_FALSE(is_blacklisted(*px_bits))) {
+      /* Entry is currently being removed.  Change it a little.         */
+      ++(*px_bits);
+      if (((AO_uintptr_t)(*px_bits) & AO_BIT_MASK) == 0)
+        /* Version count overflowed; EXTREMELY unlikely, but possible.  */
+        *px_bits = (AO_internal_ptr_t)first;
+      goto retry;
+    }
 
-        if (AO_EXPECT_FALSE(entry1 == x_bits || entry2 == x_bits))
-#     else
-        int i;
+    /* *px_bits value is not currently being deleted.   */
+    *pnext = next;
+    return AO_cptr_compare_and_swap_release(
+                        (AO_internal_ptr_t volatile *)list, next, *px_bits);
+  }
 
-        for (i = 0; i < AO_BL_SIZE; ++i)
-          if (AO_EXPECT_FALSE(AO_cptr_load(&a->AO_stack_bl[i]) == x_bits))
-#     endif
-        {
-          /* Entry is currently being removed.  Change it a little.     */
-          ++x_bits;
-          if (((AO_uintptr_t)x_bits & AO_BIT_MASK) == 0)
-            /* Version count overflowed; EXTREMELY unlikely, but possible. */
-            x_bits = (AO_internal_ptr_t)x;
-          goto retry;
-        }
+  /* Insert the chain linked from first to last (pointers to the link   */
+  /* fields of its first and last elements).  Every link in the chain   */
+  /* inserts its target just as the list head does, so none of them    */
+  /* may hold a value that is on the black list.  The chain is private  */
+  /* to us, so its interior links need to be checked only once.         */
+  /* Returns nonzero if the list was empty.                             */
+  static int push_chain_release(volatile AO_uintptr_t *list,
+                                AO_uintptr_t *first, AO_uintptr_t *last)
+  {
+    AO_internal_ptr_t x_bits = (AO_internal_ptr_t)first;
+    AO_internal_ptr_t next;
+    AO_internal_ptr_t *p;
+
+    for (p = (AO_internal_ptr_t *)first; p != (AO_internal_ptr_t *)last; ) {
+      AO_internal_ptr_t bits = *p;
+      AO_internal_ptr_t *target =
+                (AO_internal_ptr_t *)AO_REAL_NEXT_PTR(*(AO_uintptr_t *)&bits);
+
+      while (AO_EXPECT_FALSE(is_blacklisted(bits))) {
+        ++bits;
+        if (((AO_uintptr_t)bits & AO_BIT_MASK) == 0)
+          bits = (AO_internal_ptr_t)target;
       }
+      *p = bits;
+      p = target;
+    }
 
-      /* x_bits value is not currently being deleted.   */
-    } while (AO_EXPECT_FALSE(!AO_cptr_compare_and_swap_release(
-                        (AO_internal_ptr_t volatile *)list, next, x_bits)));
+    while (AO_EXPECT_FALSE(!try_push_head(list, &x_bits, first, last,
+                                          &next))) {
+      /* Retry.  */
+    }
+    return 0 == next;
+  }
+
+  /* The second argument is a pointer to the link field of the element  */
+  /* to be inserted.                                                    */
+  /* Both list headers and link fields contain "perturbed" pointers,    */
+  /* i.e. pointers with extra bits or'ed into the low order bits.       */
+  AO_API void AO_stack_push_explicit_aux_release(volatile AO_uintptr_t *list,
+                                                 AO_uintptr_t *x,
+                                                 AO_stack_aux *a)
+  {
+    (void)a;
+    (void)push_chain_release(list, x, x);
   }
 
   /* I concluded experimentally that checking a value first before      */
@@ -208,39 +387,165 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
 #   define load_next AO_cptr_load
 # endif
 
-  AO_API AO_uintptr_t *AO_stack_pop_explicit_aux_acquire(
-                                                volatile AO_uintptr_t *list,
-                                                AO_stack_aux *a)
+  /* The block of hazard slots after b, allocated if there is none yet; */
+  /* NULL if out of memory.                                             */
+  static struct hazard_block *next_hazard_block(struct hazard_block *b)
   {
-    unsigned i;
-    int j = 0;
+    AO_internal_ptr_t next = AO_cptr_load_acquire(&b->next);
+
+    if (0 == next) {
+      struct hazard_block *nb =
+                (struct hazard_block *)calloc(1, sizeof(struct hazard_block));
+      AO_internal_ptr_t /* no const */ zero = 0;
+
+      if (NULL == nb)
+        return NULL;
+      if (AO_cptr_compare_and_swap_release(&b->next, zero,
+                                           (AO_internal_ptr_t)nb)) {
+        next = (AO_internal_ptr_t)nb;
+      } else {
+        free(nb);
+        next = AO_cptr_load_acquire(&b->next);
+      }
+    }
+    return (struct hazard_block *)next;
+  }
+
+  AO_API int AO_stack_reserve_hazard_slots(AO_t n)
+  {
+    struct hazard_block *b = &hazard_slots;
+
+    for (; n > AO_HAZARD_BLOCK_SIZE; n -= AO_HAZARD_BLOCK_SIZE) {
+      b = next_hazard_block(b);
+      if (NULL == b)
+        return 0;
+    }
+    return 1;
+  }
+
+  /* Where the calling thread starts searching a block for a free slot. */
+  /* As in local_shard (without a thread-local variable), the address   */
+  /* of a local variable identifies the thread; unlike a thread-local   */
+  /* variable, it is safe to use in a signal handler.                   */
+  static AO_t hazard_start(void)
+  {
+    volatile char probe = 0;
+    unsigned h = (unsigned)((AO_uintptr_t)&probe >> 20) * 2654435761U;
+
+    return (h >> 16) % AO_HAZARD_BLOCK_SIZE;
+  }
+
+  /* The slot of index i (counted across the blocks), which exists.     */
+  static AO_internal_ptr_t volatile *hazard_slot_at(AO_t i)
+  {
+    struct hazard_block *b = &hazard_slots;
+
+    for (; i >= AO_HAZARD_BLOCK_SIZE; i -= AO_HAZARD_BLOCK_SIZE)
+      b = (struct hazard_block *)AO_cptr_load_acquire(&b->next);
+    return &b->slot[i];
+  }
+
+  /* Put first on the blacklist; returns the claimed slot, and stores   */
+  /* its index to *pi.  *pj is the back-off count if no slot can be     */
+  /* found or allocated.                                                */
+  static AO_internal_ptr_t volatile *claim_hazard_slot(
+                                AO_internal_ptr_t first, AO_t *pi, int *pj)
+  {
+    struct hazard_block *b = &hazard_slots;
+    AO_t start = hazard_start();
+    AO_t base = 0; /* the index of b->slot[0] */
+    AO_t k = 0;
+
+    for (;;) {
+      AO_t i = base + (start + k) % AO_HAZARD_BLOCK_SIZE;
+      AO_internal_ptr_t volatile *slot = &b->slot[i - base];
+      AO_internal_ptr_t /* no const */ zero = 0;
+
+      if (PRECHECK(*slot)
+          AO_cptr_compare_and_swap_acquire(slot, zero, first)) {
+        /* Make the slot visible to the pushes before first is checked  */
+        /* to be still on top of the list.                              */
+        AO_t hwm;
+
+        do {
+          hwm = AO_load(&hazard_hwm);
+        } while (hwm <= i
+                 && !AO_compare_and_swap_full(&hazard_hwm, hwm, i + 1));
+        *pi = i;
+        return slot;
+      }
+      if (++k == AO_HAZARD_BLOCK_SIZE) {
+        struct hazard_block *nb = next_hazard_block(b);
+
+        k = 0;
+        if (NULL == nb) {
+          /* Wait for a busy slot to be freed.  */
+          AO_pause(++(*pj));
+          b = &hazard_slots;
+          base = 0;
+          continue;
+        }
+        b = nb;
+        base += AO_HAZARD_BLOCK_SIZE;
+      }
+    }
+  }
+
+  /* Free the slot of index i.  If it is beyond the first block, lower  */
+  /* the high-water mark past the free slots at the top, so that the    */
+  /* pushes stop scanning the blocks that a burst of pops needed once.  */
+  /* This stops at a busy slot, whose release carries on from there.    */
+  /* Each slot is retired while the mark is lowered past it: otherwise, */
+  /* a pop could claim it, find the old mark above it, and be missed by */
+  /* the pushes after the lowering.  A pop that claims the slot once it */
+  /* is free again has seen the new mark (the store below releases it)  */
+  /* and raises it as needed.                                           */
+  static void release_hazard_slot(AO_internal_ptr_t volatile *slot, AO_t i)
+  {
+    AO_cptr_store_release(slot, 0);
+    if (i < AO_HAZARD_BLOCK_SIZE)
+      return;
+
+    for (;;) {
+      AO_t n = AO_load(&hazard_hwm);
+      AO_internal_ptr_t /* no const */ zero = 0;
+      int lowered;
+
+      if (n <= AO_HAZARD_BLOCK_SIZE)
+        break;
+      slot = hazard_slot_at(n - 1);
+      if (!AO_cptr_compare_and_swap_acquire(slot, zero, HAZARD_RETIRING))
+        break; /* in use */
+      lowered = AO_compare_and_swap_full(&hazard_hwm, n, n - 1);
+      AO_cptr_store_release(slot, 0);
+      if (!lowered)
+        break;
+    }
+  }
+
+  /* A single attempt to remove the top of the list.  Stores the result */
+  /* (NULL if the list is empty) to *presult unless the CAS on the list */
+  /* head fails.  *pj is the back-off count for claim_hazard_slot.      */
+  static int try_pop_head(volatile AO_uintptr_t *list,
+                          AO_uintptr_t **presult, int *pj)
+  {
+    AO_internal_ptr_t volatile *slot;
     AO_internal_ptr_t first, next;
     AO_internal_ptr_t *first_ptr;
+    AO_t i;
 
-  retry:
     first = AO_cptr_load((AO_internal_ptr_t volatile *)list);
-    if (0 == first) return NULL;
-    /* Insert first into aux black list.                                */
-    /* This may spin if more than AO_BL_SIZE removals using auxiliary   */
-    /* structure a are currently in progress.                           */
-    for (i = 0; ; )
-      {
-        AO_internal_ptr_t /* no const */ zero = 0;
-
-        if (PRECHECK(a->AO_stack_bl[i])
-            AO_cptr_compare_and_swap_acquire(a->AO_stack_bl+i, zero, first))
-          break;
-        if (++i >= AO_BL_SIZE)
-          {
-            i = 0;
-            AO_pause(++j);
-          }
-      }
+    if (0 == first) {
+      *presult = NULL;
+      return 1;
+    }
+    /* Insert first into the black list.                                */
+    slot = claim_hazard_slot(first, &i, pj);
 #   ifndef AO_THREAD_SANITIZER
-      assert(a->AO_stack_bl[i] == first);
+      assert(*slot == first);
                                 /* No actual race with the above CAS.   */
 #   endif
-    /* first is on the auxiliary black list.  It may be removed by      */
+    /* first is on the black list (in our slot).  It may be removed by  */
     /* another thread before we get to it, but a new insertion of x     */
     /* cannot be started here.  Only we can remove it from the black    */
     /* list.  We need to make sure that first is still the first entry  */
@@ -252,8 +557,8 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
                         /* using acquire ordering semantics for this    */
                         /* load.  Probably, it is not the right fix.    */
     {
-      AO_cptr_store_release(a->AO_stack_bl+i, 0);
-      goto retry;
+      release_hazard_slot(slot, i);
+      return 0;
     }
     first_ptr = (AO_internal_ptr_t *)AO_REAL_NEXT_PTR(*(AO_uintptr_t *)&first);
     next = load_next(first_ptr);
@@ -261,8 +566,8 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
                                         (AO_internal_ptr_t volatile *)list,
                                         first, next)))
     {
-      AO_cptr_store_release(a->AO_stack_bl+i, 0);
-      goto retry;
+      release_hazard_slot(slot, i);
+      return 0;
     }
 #   ifndef AO_THREAD_SANITIZER
       assert(*(AO_internal_ptr_t *)list != first);
@@ -277,30 +582,124 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
     /* since the part of the list following first must have remained    */
     /* unchanged, and first must again have been at the head of the     */
     /* list when the compare_and_swap succeeded.                        */
-    AO_cptr_store_release(a->AO_stack_bl+i, 0);
-    return (AO_uintptr_t *)first_ptr;
+    release_hazard_slot(slot, i);
+    *presult = (AO_uintptr_t *)first_ptr;
+    return 1;
   }
 
-  AO_API void AO_stack_push_release(AO_stack_t *list, AO_uintptr_t *x)
+  AO_API AO_uintptr_t *AO_stack_pop_explicit_aux_acquire(
+                                                volatile AO_uintptr_t *list,
+                                                AO_stack_aux *a)
   {
-    AO_stack_push_explicit_aux_release(
+    AO_uintptr_t *result;
+    int j = 0;
+
+    (void)a;
+    while (AO_EXPECT_FALSE(!try_pop_head(list, &result, &j))) {
+      /* Retry.  */
+    }
+    return result;
+  }
+
+  /* A concurrent pop that has first on its black list cannot be fooled */
+  /* by this: first may come back to the top only by a new push, which  */
+  /* perturbs it while it is black-listed.  Thus, no version is needed. */
+  AO_API AO_uintptr_t *AO_stack_pop_all_acquire(AO_stack_t *list)
+  {
+    AO_internal_ptr_t volatile *head =
+                        (AO_internal_ptr_t volatile *)&list->AO_pa.AO_ptr;
+    AO_internal_ptr_t first;
+
+    do {
+      first = AO_cptr_load(head);
+      if (0 == first) return NULL;
+    } while (AO_EXPECT_FALSE(!AO_cptr_compare_and_swap_acquire(head, first,
+                                                               0)));
+#   ifdef AO_STACK_COUNT
+      count_add(list, 0 - chain_length(
+                        AO_REAL_NEXT_PTR(*(AO_uintptr_t *)&first), NULL));
+#   endif
+    return AO_REAL_NEXT_PTR(*(AO_uintptr_t *)&first);
+  }
+
+  static int try_push(AO_stack_t *list, AO_uintptr_t *x)
+  {
+    AO_internal_ptr_t x_bits = (AO_internal_ptr_t)x;
+    AO_internal_ptr_t next;
+
+    if (AO_EXPECT_FALSE(!try_push_head(
                                 (volatile AO_uintptr_t *)&list->AO_pa.AO_ptr,
-                                x, &list->AO_pa.AO_aux);
+                                &x_bits, x, x, &next)))
+      return 0;
+    count_add(list, 1);
+    if (0 == next)
+      wake_waiters(list);
+    return 1;
+  }
+
+  static int try_pop(AO_stack_t *list, AO_uintptr_t **presult)
+  {
+    int j = 0;
+
+    if (AO_EXPECT_FALSE(!try_pop_head(
+                                (volatile AO_uintptr_t *)&list->AO_pa.AO_ptr,
+                                presult, &j)))
+      return 0;
+    if (*presult != NULL)
+      count_add(list, -1);
+    return 1;
+  }
+
+  AO_API void AO_stack_push_release(AO_stack_t *list, AO_uintptr_t *x)
+  {
+    int was_empty = push_chain_release(
+                        (volatile AO_uintptr_t *)&list->AO_pa.AO_ptr, x, x);
+
+    count_add(list, 1);
+    if (was_empty)
+      wake_waiters(list);
+  }
+
+  AO_API void AO_stack_push_list_release(AO_stack_t *list,
+                                         AO_uintptr_t *first,
+                                         AO_uintptr_t *last)
+  {
+#   ifdef AO_STACK_COUNT
+      AO_t n = chain_length(first, last);
+#   endif
+    int was_empty = push_chain_release(
+                (volatile AO_uintptr_t *)&list->AO_pa.AO_ptr, first, last);
+
+    count_add(list, n);
+    if (was_empty)
+      wake_waiters(list);
   }
 
   AO_API AO_uintptr_t *AO_stack_pop_acquire(AO_stack_t *list)
   {
-    return AO_stack_pop_explicit_aux_acquire(
+    AO_uintptr_t *result = AO_stack_pop_explicit_aux_acquire(
                                 (volatile AO_uintptr_t *)&list->AO_pa.AO_ptr,
                                 &list->AO_pa.AO_aux);
+
+    if (result != NULL)
+      count_add(list, -1);
+    return result;
   }
 
 #else /* !AO_USE_ALMOST_LOCK_FREE */
 
+  /* Pops need no hazard slots here.    */
+  AO_API int AO_stack_reserve_hazard_slots(AO_t n)
+  {
+    (void)n;
+    return 1;
+  }
+
   /* The functionality is the same as of load_next but the atomicity    */
   /* is not needed.  The usage is similar to that of store_before_cas.  */
 # if defined(AO_THREAD_SANITIZER) \
-     && defined(AO_HAVE_compare_double_and_swap_double)
+     && (defined(AO_HAVE_compare_double_and_swap_double) \
+         || defined(AO_STACK_USE_PTR_TAG))
     /* TODO: If compiled by Clang (as of clang-4.0) with -O3 flag,      */
     /* no_sanitize attribute is ignored unless the argument is volatile.*/
 #   if defined(__clang__)
@@ -317,6 +716,137 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
 #   define load_before_cas(addr) (*(addr))
 # endif /* !AO_THREAD_SANITIZER */
 
+# ifdef AO_STACK_USE_PTR_TAG
+    /* The head word holds the pointer to the link field of the top     */
+    /* element in the lower bits (AO_STACK_PTR_MASK) and a version in   */
+    /* the upper ones, which is incremented by every pop (as in the     */
+    /* double-word CAS implementation below).  The link fields hold     */
+    /* plain pointers.                                                  */
+#   define head AO_pa.AO_ptr
+#   define PTR_VERSION_ONE (AO_STACK_PTR_MASK + 1)
+
+    /* An element address with any of the upper bits set (a pointer     */
+    /* tagged by TBI, MTE or HWASan, or a 5-level paging high mapping)  */
+    /* would corrupt the version and the head, so it is rejected.       */
+    static void check_untagged(const AO_uintptr_t *p)
+    {
+      if (AO_EXPECT_FALSE(((AO_t)p & ~AO_STACK_PTR_MASK) != 0)) {
+        fprintf(stderr, "AO_stack: element %p does not fit in"
+                " AO_STACK_PTR_MASK\n", (const void *)p);
+        abort();
+      }
+    }
+
+    static int try_push_chain(AO_stack_t *list, AO_uintptr_t *first,
+                              AO_uintptr_t *last, AO_t *pnext)
+    {
+      AO_t h = AO_load((volatile AO_t *)&list->head);
+
+      check_untagged(first);
+      *pnext = h & AO_STACK_PTR_MASK;
+      store_before_cas(last, *pnext);
+      return AO_compare_and_swap_release((volatile AO_t *)&list->head, h,
+                                (h & ~AO_STACK_PTR_MASK) | (AO_t)first);
+    }
+
+    static int try_push(AO_stack_t *list, AO_uintptr_t *element)
+    {
+      AO_t next;
+
+      if (AO_EXPECT_FALSE(!try_push_chain(list, element, element, &next)))
+        return 0;
+      count_add(list, 1);
+      if (0 == next)
+        wake_waiters(list);
+      return 1;
+    }
+
+    static int try_pop(AO_stack_t *list, AO_uintptr_t **presult)
+    {
+      AO_t h = AO_load_acquire((volatile AO_t *)&list->head);
+      AO_t *cptr = (AO_t *)(h & AO_STACK_PTR_MASK);
+
+      if (cptr != NULL) {
+        AO_t next = load_before_cas((/* no volatile */ AO_t *)cptr);
+
+        if (AO_EXPECT_FALSE(!AO_compare_and_swap_release(
+                                (volatile AO_t *)&list->head, h,
+                                ((h & ~AO_STACK_PTR_MASK) + PTR_VERSION_ONE)
+                                | next)))
+          return 0;
+        count_add(list, -1);
+      }
+      *presult = (AO_uintptr_t *)cptr;
+      return 1;
+    }
+
+    AO_API void AO_stack_push_release(AO_stack_t *list,
+                                      AO_uintptr_t *element)
+    {
+      AO_t next;
+
+      while (AO_EXPECT_FALSE(!try_push_chain(list, element, element,
+                                             &next))) {
+        /* Retry.  */
+      }
+      count_add(list, 1);
+      if (0 == next)
+        wake_waiters(list);
+    }
+
+    AO_API void AO_stack_push_list_release(AO_stack_t *list,
+                                           AO_uintptr_t *first,
+                                           AO_uintptr_t *last)
+    {
+#     ifdef AO_STACK_COUNT
+        AO_t n = chain_length(first, last);
+#     endif
+      AO_uintptr_t *p;
+      AO_t next;
+
+      /* The interior links become list links as they are.      */
+      for (p = first; p != last; p = (AO_uintptr_t *)*p)
+        check_untagged(p);
+      check_untagged(last);
+      while (AO_EXPECT_FALSE(!try_push_chain(list, first, last, &next))) {
+        /* Retry.  */
+      }
+      count_add(list, n);
+      if (0 == next)
+        wake_waiters(list);
+    }
+
+    AO_API AO_uintptr_t *AO_stack_pop_acquire(AO_stack_t *list)
+    {
+      AO_uintptr_t *result;
+
+      while (AO_EXPECT_FALSE(!try_pop(list, &result))) {
+        /* Retry.  */
+      }
+      return result;
+    }
+
+    AO_API AO_uintptr_t *AO_stack_pop_all_acquire(AO_stack_t *list)
+    {
+      AO_t h;
+
+      do {
+        h = AO_load_acquire((volatile AO_t *)&list->head);
+        if ((h & AO_STACK_PTR_MASK) == 0)
+          return NULL;
+      } while (AO_EXPECT_FALSE(!AO_compare_and_swap_release(
+                                (volatile AO_t *)&list->head, h,
+                                (h & ~AO_STACK_PTR_MASK) + PTR_VERSION_ONE)));
+#     ifdef AO_STACK_COUNT
+        count_add(list, 0 - chain_length(
+                        (AO_uintptr_t *)(h & AO_STACK_PTR_MASK), NULL));
+#     endif
+      return (AO_uintptr_t *)(h & AO_STACK_PTR_MASK);
+    }
+
+#   undef head
+# else
+
   /* Better names for fields in AO_stack_t.     */
 # define version AO_vp.AO_val1
 # define ptr AO_vp.AO_val2
@@ -325,26 +855,61 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
     volatile /* non-static */ AO_t AO_noop_sink;
 # endif
 
-  AO_API void AO_stack_push_release(AO_stack_t *list, AO_uintptr_t *element)
+  /* With AO_STACK_COUNT, the lower half of the version word holds the  */
+  /* element count and the upper half is the actual version, so a push  */
+  /* updates both words, and a pop decrements the count along with      */
+  /* incrementing the version.  (With a 32-bit AO_t, this leaves only   */
+  /* 16 bits for the version.)                                          */
+# ifdef AO_STACK_COUNT
+#   define COUNT_MASK (((AO_t)1 << (sizeof(AO_t) * 4)) - 1)
+#   define POP_VERSION(v) ((v) + COUNT_MASK)
+#   define POP_ALL_VERSION(v) (((v) | COUNT_MASK) + 1)
+# else
+#   define POP_VERSION(v) ((v) + 1)
+#   define POP_ALL_VERSION(v) ((v) + 1)
+# endif
+
+  /* A single attempt to push the chain from first to last (of n        */
+  /* elements).  This uses a narrow CAS here, an old optimization       */
+  /* suggested by Treiber.  Pop is still safe, since we run into the    */
+  /* ABA problem only if there were both intervening pops and pushes.   */
+  /* In that case we still see a change in the version number.  The     */
+  /* chain is private until it is published, so only the link field of */
+  /* last needs to be updated.                                          */
+  static int try_push_chain(AO_stack_t *list, AO_uintptr_t *first,
+                            AO_uintptr_t *last, AO_t n, AO_t *pnext)
   {
-    AO_t next;
+#   ifdef AO_STACK_COUNT
+      AO_t cversion = AO_load_acquire(&list->version);
+#   endif
+    AO_t next = AO_load(&list->ptr);
 
-    do {
-      next = AO_load(&list->ptr);
-      store_before_cas(element, next);
-    } while (AO_EXPECT_FALSE(!AO_compare_and_swap_release(&list->ptr, next,
-                                                          (AO_t)element)));
-    /* This uses a narrow CAS here, an old optimization suggested   */
-    /* by Treiber.  Pop is still safe, since we run into the ABA    */
-    /* problem only if there were both intervening pops and pushes. */
-    /* In that case we still see a change in the version number.    */
-#   ifdef LINT2
-      /* Instruct static analyzer that element is not lost.     */
-      AO_noop_sink = (AO_t)element;
+    *pnext = next;
+    store_before_cas(last, next);
+#   ifdef AO_STACK_COUNT
+      return AO_compare_double_and_swap_double_release(&list->AO_vp,
+                                        cversion, next,
+                                        cversion + n, (AO_t)first);
+#   else
+      (void)n;
+      return AO_compare_and_swap_release(&list->ptr, next, (AO_t)first);
 #   endif
   }
 
-  AO_API AO_uintptr_t *AO_stack_pop_acquire(AO_stack_t *list)
+  static int try_push(AO_stack_t *list, AO_uintptr_t *element)
+  {
+    AO_t next;
+
+    if (AO_EXPECT_FALSE(!try_push_chain(list, element, element, 1, &next)))
+      return 0;
+    if (0 == next)
+      wake_waiters(list);
+    return 1;
+  }
+
+  /* A single attempt to pop; stores the result (NULL if the stack is   */
+  /* empty) to *presult unless the double-word CAS fails.               */
+  static int try_pop(AO_stack_t *list, AO_uintptr_t **presult)
   {
 #   if defined(__clang__) && !AO_CLANG_PREREQ(3, 5)
       AO_t *volatile cptr;
@@ -356,19 +921,370 @@ AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t next)
     AO_t next;
     AO_t cversion;
 
+    /* Version must be loaded first.  */
+    cversion = AO_load_acquire(&list->version);
+    cptr = (AO_t *)AO_load(&list->ptr);
+    if (cptr != NULL) {
+      next = load_before_cas((/* no volatile */ AO_t *)cptr);
+      if (AO_EXPECT_FALSE(!AO_compare_double_and_swap_double_release(
+                                        &list->AO_vp, cversion, (AO_t)cptr,
+                                        POP_VERSION(cversion), next)))
+        return 0;
+    }
+    *presult = (AO_uintptr_t *)cptr;
+    return 1;
+  }
+
+  AO_API void AO_stack_push_release(AO_stack_t *list, AO_uintptr_t *element)
+  {
+    AO_t next;
+
+    while (AO_EXPECT_FALSE(!try_push_chain(list, element, element, 1,
+                                           &next))) {
+      /* Retry.  */
+    }
+#   ifdef LINT2
+      /* Instruct static analyzer that element is not lost.     */
+      AO_noop_sink = (AO_t)element;
+#   endif
+    if (0 == next)
+      wake_waiters(list);
+  }
+
+  AO_API void AO_stack_push_list_release(AO_stack_t *list,
+                                         AO_uintptr_t *first,
+                                         AO_uintptr_t *last)
+  {
+#   ifdef AO_STACK_COUNT
+      AO_t n = chain_length(first, last);
+#   else
+      AO_t n = 0; /* unused */
+#   endif
+    AO_t next;
+
+
+    while (AO_EXPECT_FALSE(!try_push_chain(list, first, last, n, &next))) {
+      /* Retry.  */
+    }
+#   ifdef LINT2
+      AO_noop_sink = (AO_t)first;
+#   endif
+    if (0 == next)
+      wake_waiters(list);
+  }
+
+  AO_API AO_uintptr_t *AO_stack_pop_acquire(AO_stack_t *list)
+  {
+    AO_uintptr_t *result;
+
+    while (AO_EXPECT_FALSE(!try_pop(list, &result))) {
+      /* Retry.  */
+    }
+    return result;
+  }
+
+  AO_API AO_uintptr_t *AO_stack_pop_all_acquire(AO_stack_t *list)
+  {
+    AO_t *cptr;
+    AO_t cversion;
+
+    /* The version is bumped as by a pop, so that a concurrent pop of   */
+    /* the old top cannot succeed even if it is pushed back meanwhile.  */
     do {
-      /* Version must be loaded first.  */
       cversion = AO_load_acquire(&list->version);
       cptr = (AO_t *)AO_load(&list->ptr);
       if (NULL == cptr)
         break;
-      next = load_before_cas((/* no volatile */ AO_t *)cptr);
     } while (AO_EXPECT_FALSE(!AO_compare_double_and_swap_double_release(
                                         &list->AO_vp, cversion, (AO_t)cptr,
-                                        cversion+1, next)));
+                                        POP_ALL_VERSION(cversion), 0)));
     return (AO_uintptr_t *)cptr;
   }
 
+# ifdef AO_STACK_COUNT
+    AO_API AO_t AO_stack_approx_size(const AO_stack_t *list)
+    {
+      return AO_load(&list->version) & COUNT_MASK;
+    }
+# endif
+
 # undef ptr
 # undef version
+# endif /* !AO_STACK_USE_PTR_TAG */
 #endif /* !AO_USE_ALMOST_LOCK_FREE */
+
+#if defined(AO_STACK_COUNT) \
+    && (defined(AO_USE_ALMOST_LOCK_FREE) || defined(AO_STACK_USE_PTR_TAG))
+  AO_API AO_t AO_stack_approx_size(const AO_stack_t *list)
+  {
+    AO_t n = AO_load(stack_count(list));
+
+    return n > ((AO_t)-1 >> 1) ? 0 : n;
+  }
+#endif
+
+/* The number of pop attempts (with an exponential back-off) before     */
+/* AO_stack_pop_wait parks the caller.                                  */
+#ifndef AO_STACK_WAIT_SPIN
+# define AO_STACK_WAIT_SPIN 10
+#endif
+
+#ifdef AO_STACK_USE_FUTEX
+  /* Store the time left until *deadline to *ts; returns 0 if none.     */
+  static int time_left(struct timespec *ts, const struct timespec *deadline)
+  {
+    (void)clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec = deadline->tv_sec - ts->tv_sec;
+    ts->tv_nsec = deadline->tv_nsec - ts->tv_nsec;
+    if (ts->tv_nsec < 0) {
+      ts->tv_sec--;
+      ts->tv_nsec += 1000000000L;
+    }
+    return ts->tv_sec >= 0;
+  }
+#endif
+
+AO_API AO_uintptr_t *AO_stack_pop_wait(AO_stack_t *list, long timeout)
+{
+  AO_uintptr_t *result;
+  int i;
+
+  for (i = 0; i < AO_STACK_WAIT_SPIN; ++i) {
+    result = AO_stack_pop_acquire(list);
+    if (result != NULL)
+      return result;
+    AO_pause(i);
+  }
+  if (0 == timeout)
+    return AO_stack_pop_acquire(list);
+
+# ifdef AO_STACK_USE_FUTEX
+  {
+    struct stack_wait *w = WAIT_SLOT(list);
+    struct timespec deadline, ts;
+
+    if (timeout > 0) {
+      (void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += timeout / 1000;
+      deadline.tv_nsec += (timeout % 1000) * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+    }
+    for (;;) {
+      unsigned seq;
+
+      if (timeout > 0 && !time_left(&ts, &deadline))
+        return AO_stack_pop_acquire(list);
+
+      /* Register as a waiter before checking the stack (again), so     */
+      /* that a push making it non-empty either is seen by this pop or  */
+      /* sees the waiter (and bumps seq after it has been read).        */
+      (void)AO_fetch_and_add1_full(&w->waiters);
+      seq = AO_int_load_acquire(&w->seq);
+      result = AO_stack_pop_acquire(list);
+      if (NULL == result)
+        (void)syscall(SYS_futex, &w->seq, FUTEX_WAIT_PRIVATE, seq,
+                      timeout > 0 ? &ts : NULL, NULL, 0);
+      (void)AO_fetch_and_sub1(&w->waiters);
+      if (result != NULL)
+        return result;
+    }
+  }
+# else
+    /* No way to park; poll about every millisecond.    */
+    for (;;) {
+      AO_pause(22);
+      result = AO_stack_pop_acquire(list);
+      if (result != NULL || (timeout > 0 && 0 == --timeout))
+        return result;
+    }
+# endif
+}
+
+/* Elimination back-off.  A push that failed on the stack head offers   */
+/* its element in a slot for a while and then withdraws it unless a pop */
+/* has taken it; a pop that failed on the head takes any offered one.   */
+/* The same element may reappear in a slot only after it has been       */
+/* taken and pushed again, in which case the withdrawal of the earlier  */
+/* offer is indistinguishable from that of the later one.               */
+#ifndef AO_ELIM_WAIT
+  /* The number of polls of its slot by an offering push.       */
+# define AO_ELIM_WAIT 64
+#endif
+
+#ifdef AO_STACK_USE_CPTR
+  /* The elements cannot be held in an AO_t; no elimination.   */
+# define elim_push(list, x) 0
+# define elim_pop(list) NULL
+#else
+  /* Spread concurrent operations over the slots.       */
+# define ELIM_INDEX(p) \
+        ((unsigned)(((AO_uintptr_t)(p) >> 3) ^ ((AO_uintptr_t)(p) >> 9)) \
+         % AO_ELIM_SIZE)
+
+  static int elim_push(AO_stack_elim_t *list, AO_uintptr_t *x)
+  {
+    volatile AO_t *slot = &list->AO_elim_slot[ELIM_INDEX(x)];
+    int i;
+
+    if (AO_load(slot) != 0
+        || !AO_compare_and_swap_release(slot, 0, (AO_t)x))
+      return 0;
+    for (i = 0; i < AO_ELIM_WAIT; ++i) {
+      if (AO_load(slot) != (AO_t)x)
+        return 1;
+    }
+    return !AO_compare_and_swap(slot, (AO_t)x, 0);
+  }
+
+  static AO_uintptr_t *elim_pop(AO_stack_elim_t *list)
+  {
+    unsigned i;
+    unsigned start = ELIM_INDEX(&i); /* differs between threads */
+
+    for (i = 0; i < AO_ELIM_SIZE; ++i) {
+      volatile AO_t *slot =
+                &list->AO_elim_slot[(start + i) % AO_ELIM_SIZE];
+      AO_t x = AO_load(slot);
+
+      if (x != 0 && AO_compare_and_swap_acquire(slot, x, 0))
+        return (AO_uintptr_t *)x;
+    }
+    return NULL;
+  }
+#endif /* !AO_STACK_USE_CPTR */
+
+AO_API void AO_stack_elim_push_release(AO_stack_elim_t *list,
+                                       AO_uintptr_t *x)
+{
+  while (AO_EXPECT_FALSE(!try_push(&list->AO_stack, x))) {
+    if (elim_push(list, x))
+      break;
+  }
+}
+
+AO_API AO_uintptr_t *AO_stack_elim_pop_acquire(AO_stack_elim_t *list)
+{
+  AO_uintptr_t *result;
+
+  while (AO_EXPECT_FALSE(!try_pop(&list->AO_stack, &result))) {
+    result = elim_pop(list);
+    if (result != NULL)
+      break;
+  }
+  return result;
+}
+
+#if defined(AO_STACK_NO_THREAD_LOCAL)
+  /* Use the address hash below.        */
+#elif defined(__GNUC__) && defined(__ELF__)
+# define AO_STACK_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+# define AO_STACK_THREAD_LOCAL __declspec(thread)
+#endif
+
+#ifdef AO_STACK_THREAD_LOCAL
+  static volatile AO_t next_shard = 0;
+  static AO_STACK_THREAD_LOCAL unsigned thread_shard = 0;
+                        /* the sub-stack index plus 1, 0 if not assigned */
+
+  /* The sub-stack of the calling thread, assigned round-robin on its   */
+  /* first use.                                                         */
+  static unsigned local_shard(void)
+  {
+    unsigned shard = thread_shard;
+
+    if (AO_EXPECT_FALSE(0 == shard)) {
+      shard = (unsigned)(AO_fetch_and_add1(&next_shard) % AO_STACK_SHARDS)
+                + 1;
+      thread_shard = shard;
+    }
+    return shard - 1;
+  }
+#else
+  /* The sub-stack of the calling thread.  Threads run on distinct      */
+  /* stacks (normally megabytes apart), so the address of a local       */
+  /* variable identifies the thread well enough once the bits that may  */
+  /* vary with the call depth are dropped; the rest is mixed with a     */
+  /* multiplicative hash.                                               */
+  static unsigned local_shard(void)
+  {
+    volatile char probe = 0;
+    unsigned h = (unsigned)((AO_uintptr_t)&probe >> 20) * 2654435761U;
+
+    return (h >> 16) % AO_STACK_SHARDS;
+  }
+#endif
+
+AO_API void AO_sharded_stack_push_release(AO_sharded_stack_t *list,
+                                          AO_uintptr_t *x)
+{
+  AO_stack_push_release(&list->AO_shard[local_shard()].AO_stack, x);
+}
+
+AO_API AO_uintptr_t *AO_sharded_stack_pop_acquire(AO_sharded_stack_t *list)
+{
+  unsigned start = local_shard();
+  unsigned i;
+
+  for (i = 0; i < AO_STACK_SHARDS; ++i) {
+    AO_uintptr_t *result = AO_stack_pop_acquire(
+                &list->AO_shard[(start + i) % AO_STACK_SHARDS].AO_stack);
+
+    if (result != NULL)
+      return result;
+  }
+  return NULL;
+}
+
+#ifdef AO_STACK_COUNT
+  AO_API AO_t AO_sharded_stack_approx_size(const AO_sharded_stack_t *list)
+  {
+    AO_t n = 0;
+    unsigned i;
+
+    for (i = 0; i < AO_STACK_SHARDS; ++i)
+      n += AO_stack_approx_size(&list->AO_shard[i].AO_stack);
+    return n;
+  }
+#endif
+
+/* The halves of the AO_index_stack_t head: the version, and the index  */
+/* of the top node plus 1.  The links hold the latter for the next node.*/
+#define INDEX_HALF_BITS (sizeof(AO_t) * 4)
+#define INDEX_MASK (((AO_t)1 << INDEX_HALF_BITS) - 1)
+
+AO_API void AO_index_stack_push_release(AO_index_stack_t *list,
+                                        volatile AO_t *links, AO_t index)
+{
+  AO_t head;
+
+  assert(index < INDEX_MASK);
+  /* As in AO_stack_push_release, the version need not be changed.  */
+  do {
+    head = AO_load(&list->AO_head);
+    AO_store(&links[index], head & INDEX_MASK);
+  } while (AO_EXPECT_FALSE(!AO_compare_and_swap_release(&list->AO_head, head,
+                                        (head & ~INDEX_MASK) | (index + 1))));
+}
+
+AO_API AO_t AO_index_stack_pop_acquire(AO_index_stack_t *list,
+                                       const volatile AO_t *links)
+{
+  AO_t head, top, next;
+
+  do {
+    head = AO_load_acquire(&list->AO_head);
+    top = head & INDEX_MASK;
+    if (0 == top)
+      return AO_INDEX_STACK_EMPTY;
+    /* The link may be stale if the node has been popped meanwhile, */
+    /* but then the version has changed and the CAS fails.          */
+    next = AO_load(&links[top - 1]);
+  } while (AO_EXPECT_FALSE(!AO_compare_and_swap_acquire(&list->AO_head, head,
+                        (((head >> INDEX_HALF_BITS) + 1) << INDEX_HALF_BITS)
+                        | next)));
+  return top - 1;
+}
@@ -44,6 +44,22 @@
 #ifdef AO_USE_ALMOST_LOCK_FREE
   /* Use the almost-non-blocking implementation regardless of the       */
   /* double-word CAS availability.                                      */
+#elif defined(AO_STACK_USE_PTR_TAG)
+  /* Requested by the client: user-space addresses fit in the lower 48  */
+  /* bits, so a 16-bit version is kept in the upper bits of the head,   */
+  /* and both push and pop are a single-word CAS.  The version wraps    */
+  /* after 65536 pops, and a pop that is delayed (e.g. preempted) for   */
+  /* exactly that many pops between its load and CAS may corrupt the    */
+  /* list; at millions of operations per second that takes only a few  */
+  /* milliseconds.  An element whose address has any of the upper bits  */
+  /* set is rejected with abort() at run time.                          */
+# if !(defined(__x86_64__) || defined(__aarch64__)) || !defined(__linux__) \
+     || defined(__ILP32__) || defined(AO_FAT_POINTER) \
+     || defined(AO_STACK_USE_CPTR)
+#   error AO_STACK_USE_PTR_TAG requires 64-bit x86 or AArch64 Linux
+# endif
+# define AO_STACK_PTR_MASK ((((AO_t)1) << 48) - 1)
+# define AO_STACK_IS_LOCK_FREE
 #elif (!defined(AO_HAVE_compare_double_and_swap_double) \
        && defined(AO_HAVE_compare_and_swap)) \
       || defined(AO_FAT_POINTER) || defined(AO_STACK_USE_CPTR)
@@ -58,16 +74,15 @@
 /*
  * These are not guaranteed to be completely lock-free.
  * List insertion may spin under extremely unlikely conditions.
- * It cannot deadlock due to recursive reentry unless AO_list_remove
- * is called while at least AO_BL_SIZE activations of
- * AO_list_remove are currently active in the same thread, i.e.
- * we must have at least AO_BL_SIZE recursive signal handler
- * invocations.
+ * Removals register the pointers they are working on in a black
+ * list of hazard slots shared by all lists, which grows as needed,
+ * so they do not wait for each other.  The first AO_HAZARD_BLOCK_SIZE
+ * slots are static; only a removal that finds that many others in
+ * progress allocates more (with calloc, which is not async-signal-safe),
+ * and if that fails it waits for a slot to be freed.
  *
- * All operations take an AO_list_aux argument.  It is safe to
- * share a single AO_list_aux structure among all lists, but that
- * may increase contention.  Any given list must always be accessed
- * with the same AO_list_aux structure.
+ * The AO_stack_aux arguments of the explicit_aux functions are
+ * ignored, AO_stack_aux is kept only for the ABI.
  *
  * We make some machine-dependent assumptions:
  *   - we have a compare-and-swap operation;
@@ -79,8 +94,9 @@
  */
 
 /* AO_stack_aux should be treated as opaque.  It is fully defined       */
-/* here, so it can be allocated, and also to facilitate debugging.      */
-/* Note: changing the value of AO_BL_SIZE leads to the ABI change.      */
+/* here, so it can be allocated.  It is not used by the implementation  */
+/* any longer.  Note: changing the value of AO_BL_SIZE leads to the ABI */
+/* change.                                                              */
 #ifndef AO_BL_SIZE
 # define AO_BL_SIZE 2
 #endif
@@ -164,6 +180,72 @@ typedef union AO__stack {
 /* The static initializer of the AO stack type. */
 #define AO_STACK_INITIALIZER { /* .AO_pa= */ { 0, { {0} } } }
 
+/* The number of the elimination slots in AO_stack_elim_t.              */
+/* Note: changing the value of AO_ELIM_SIZE leads to the ABI change.    */
+#ifndef AO_ELIM_SIZE
+# define AO_ELIM_SIZE 4
+#endif
+
+/* A stack with an elimination array (Hendler, Shavit and Yerushalmi)   */
+/* in front of it.  A push or pop that fails its CAS on the stack head  */
+/* tries to meet an opposite operation in one of the side slots; if it  */
+/* does, both complete without touching the head.  Should be treated    */
+/* as opaque, except that AO_stack may be passed to the AO_stack_...    */
+/* functions and macros (e.g., to AO_REAL_HEAD_PTR).                    */
+typedef struct AO__stack_elim {
+  AO_stack_t AO_stack;
+  volatile AO_t AO_elim_slot[AO_ELIM_SIZE];
+} AO_stack_elim_t;
+
+/* The static initializer of AO_stack_elim_t. */
+#define AO_STACK_ELIM_INITIALIZER { AO_STACK_INITIALIZER, {0} }
+
+/* The number of the sub-stacks in AO_sharded_stack_t.                  */
+/* Note: changing the value of AO_STACK_SHARDS leads to the ABI change. */
+#ifndef AO_STACK_SHARDS
+# define AO_STACK_SHARDS 8
+#endif
+
+#define AO_STACK_SHARD_PAD_SIZE \
+        ((sizeof(AO_stack_t) + AO_CACHE_LINE_SIZE - 1) \
+         / AO_CACHE_LINE_SIZE * AO_CACHE_LINE_SIZE)
+
+typedef union AO__stack_shard {
+  AO_stack_t AO_stack;
+  char AO_pad[AO_STACK_SHARD_PAD_SIZE];
+} AO_stack_shard;
+
+/* A set of stacks, each padded to whole cache lines, that is used as   */
+/* a single unordered pool (e.g., a free list).  A thread pushes to and */
+/* pops from the sub-stack selected by its identity, and steals from    */
+/* the other ones only if its own is empty.  Thus, the LIFO order holds */
+/* only per sub-stack.  Should be treated as opaque.                    */
+typedef struct AO__sharded_stack {
+  AO_stack_shard AO_shard[AO_STACK_SHARDS];
+} AO_sharded_stack_t;
+
+/* The static initializer of AO_sharded_stack_t. */
+#define AO_SHARDED_STACK_INITIALIZER { { { AO_STACK_INITIALIZER } } }
+
+/* A fully lock-free stack of the nodes of a single array, identified   */
+/* by their indices.  Its head packs the index of the top node (plus 1, */
+/* zero meaning empty) into the lower half of an AO_t, and a version    */
+/* (incremented by each pop) into the upper half, so both push and pop  */
+/* are a single-word CAS.  The links live in an array of AO_t, one per  */
+/* node, which is passed to each operation; they should be treated as   */
+/* opaque.  With a 64-bit AO_t, there may be up to 2**32-1 nodes and    */
+/* the version is 32-bit; with a 32-bit AO_t, both are 16-bit, so the   */
+/* version may wrap while a preempted pop is in progress, it is thus    */
+/* intended for 64-bit targets mainly.                                  */
+typedef struct AO__index_stack {
+  volatile AO_t AO_head;
+} AO_index_stack_t;
+
+#define AO_INDEX_STACK_INITIALIZER { 0 }
+
+/* The value returned by a pop from an empty AO_index_stack_t.          */
+#define AO_INDEX_STACK_EMPTY (~(AO_t)0)
+
 #ifdef AO_USE_ALMOST_LOCK_FREE
   /* The following two routines should not normally be used directly.   */
   /* We make them visible here for the rare cases in which it makes     */
@@ -203,6 +285,10 @@ typedef union AO__stack {
 # endif
 # define AO_REAL_HEAD_PTR(x) \
             AO_REAL_NEXT_PTR(*(volatile AO_uintptr_t *)&(&(x))->AO_pa.AO_ptr)
+#elif defined(AO_STACK_USE_PTR_TAG)
+# define AO_REAL_NEXT_PTR(x) ((AO_t *)*(&(x)))
+# define AO_REAL_HEAD_PTR(x) \
+            (AO_t *)((&(x))->AO_pa.AO_ptr & AO_STACK_PTR_MASK)
 #else
 # define AO_REAL_NEXT_PTR(x) ((AO_t *)*(&(x)))
 # define AO_REAL_HEAD_PTR(x) (AO_t *)((&(x))->AO_vp.AO_val2 /* ptr */)
@@ -215,15 +301,109 @@ AO_API void AO_stack_push_release(AO_stack_t *,
 #define AO_stack_push(l, e) AO_stack_push_release(l, e)
 #define AO_HAVE_stack_push
 
+/* Push a chain of elements, linked privately through their link fields */
+/* from first to last, with a single CAS on the stack head.  The link   */
+/* field of last is overwritten; first becomes the top of the stack.    */
+AO_API void AO_stack_push_list_release(AO_stack_t *,
+                                       AO_uintptr_t * /* first */,
+                                       AO_uintptr_t * /* last */);
+#define AO_HAVE_stack_push_list_release
+
+#define AO_stack_push_list(l, f, e) AO_stack_push_list_release(l, f, e)
+#define AO_HAVE_stack_push_list
+
 AO_API AO_uintptr_t *AO_stack_pop_acquire(AO_stack_t *);
 #define AO_HAVE_stack_pop_acquire
 
 #define AO_stack_pop(l) AO_stack_pop_acquire(l)
 #define AO_HAVE_stack_pop
 
+/* Detach all the elements at once, leaving the stack empty.  Returns   */
+/* the link field of the former top element (or NULL), the rest of the  */
+/* chain is private to the caller and is walked with AO_REAL_NEXT_PTR.  */
+AO_API AO_uintptr_t *AO_stack_pop_all_acquire(AO_stack_t *);
+#define AO_HAVE_stack_pop_all_acquire
+
+#define AO_stack_pop_all(l) AO_stack_pop_all_acquire(l)
+#define AO_HAVE_stack_pop_all
+
+/* Pop, waiting up to timeout milliseconds (indefinitely if negative)   */
+/* for an element if the stack is empty; returns NULL on timeout.       */
+/* After a brief spin, the caller is parked (on a futex on Linux) until */
+/* AO_stack_push, AO_stack_push_list or AO_stack_elim_push (to the      */
+/* AO_stack_elim_t containing it) makes the stack non-empty.            */
+AO_API AO_uintptr_t *AO_stack_pop_wait(AO_stack_t *, long /* timeout */);
+#define AO_HAVE_stack_pop_wait
+
+AO_API void AO_stack_elim_push_release(AO_stack_elim_t *,
+                                       AO_uintptr_t * /* new_element */);
+#define AO_HAVE_stack_elim_push_release
+
+#define AO_stack_elim_push(l, e) AO_stack_elim_push_release(l, e)
+#define AO_HAVE_stack_elim_push
+
+AO_API AO_uintptr_t *AO_stack_elim_pop_acquire(AO_stack_elim_t *);
+#define AO_HAVE_stack_elim_pop_acquire
+
+#define AO_stack_elim_pop(l) AO_stack_elim_pop_acquire(l)
+#define AO_HAVE_stack_elim_pop
+
+AO_API void AO_sharded_stack_push_release(AO_sharded_stack_t *,
+                                          AO_uintptr_t * /* new_element */);
+#define AO_HAVE_sharded_stack_push_release
+
+#define AO_sharded_stack_push(l, e) AO_sharded_stack_push_release(l, e)
+#define AO_HAVE_sharded_stack_push
+
+AO_API AO_uintptr_t *AO_sharded_stack_pop_acquire(AO_sharded_stack_t *);
+#define AO_HAVE_sharded_stack_pop_acquire
+
+#define AO_sharded_stack_pop(l) AO_sharded_stack_pop_acquire(l)
+#define AO_HAVE_sharded_stack_pop
+
+AO_API void AO_index_stack_push_release(AO_index_stack_t *,
+                                        volatile AO_t * /* links */,
+                                        AO_t /* index */);
+#define AO_HAVE_index_stack_push_release
+
+#define AO_index_stack_push(l, links, i) \
+                AO_index_stack_push_release(l, links, i)
+#define AO_HAVE_index_stack_push
+
+/* Returns the index of the popped node or AO_INDEX_STACK_EMPTY.        */
+AO_API AO_t AO_index_stack_pop_acquire(AO_index_stack_t *,
+                                       const volatile AO_t * /* links */);
+#define AO_HAVE_index_stack_pop_acquire
+
+#define AO_index_stack_pop(l, links) AO_index_stack_pop_acquire(l, links)
+#define AO_HAVE_index_stack_pop
+
+#ifdef AO_STACK_COUNT
+  /* If the library and its clients are built with AO_STACK_COUNT, the  */
+  /* stacks keep an element count next to the list head: in the version */
+  /* word of the double-word CAS implementation (thus, the pushes there */
+  /* use the double-width CAS too) or in the otherwise unused AO_aux of */
+  /* the other ones.  The result is exact only when the stack is not    */
+  /* being modified.                                                    */
+  AO_API AO_t AO_stack_approx_size(const AO_stack_t *);
+# define AO_HAVE_stack_approx_size
+
+  /* The sum of the approximate sizes of the sub-stacks.        */
+  AO_API AO_t AO_sharded_stack_approx_size(const AO_sharded_stack_t *);
+# define AO_HAVE_sharded_stack_approx_size
+#endif
+
 AO_API void AO_stack_init(AO_stack_t *);
 AO_API int AO_stack_is_lock_free(void);
 
+/* Preallocate the hazard slots for n pops in progress at once (on all  */
+/* the stacks), so that these pops never call calloc.  Returns 0 if out */
+/* of memory.  A no-op in the fully lock-free implementations.          */
+AO_API int AO_stack_reserve_hazard_slots(AO_t /* n */);
+AO_API void AO_stack_elim_init(AO_stack_elim_t *);
+AO_API void AO_sharded_stack_init(AO_sharded_stack_t *);
+AO_API void AO_index_stack_init(AO_index_stack_t *);
+
 /* These primitives should not be used directly.        */
 AO_API AO_uintptr_t *AO_stack_head_ptr(const AO_stack_t *);
 AO_API AO_uintptr_t *AO_stack_next_ptr(AO_uintptr_t); /* deprecated */
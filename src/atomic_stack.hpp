@@ -0,0 +1,81 @@
+#pragma once
+
+#include "atomic_ops_stack.h"
+#include <cstddef>
+#include <type_traits>
+
+namespace ao {
+
+// A typed view of AO_stack_t: elements of type T are linked through the
+// AO_uintptr_t member at byte offset LinkOffset, so push/pop take and
+// return T without casts:
+//
+//   struct node { AO_uintptr_t link; int value; };
+//   ao::intrusive_stack<node, offsetof(node, link)> free_nodes;
+//
+// Pushed elements must stay addressable while any push or pop is in
+// progress, see README_stack.txt.
+template<typename T, std::size_t LinkOffset>
+class intrusive_stack
+{
+    static_assert(std::is_standard_layout_v<T>, "offsetof() needs a standard-layout element type");
+    static_assert(LinkOffset + sizeof(AO_uintptr_t) <= sizeof(T)
+                      && LinkOffset % alignof(AO_uintptr_t) == 0,
+                  "LinkOffset does not name an AO_uintptr_t member of T");
+
+public:
+    using value_type = T;
+
+    constexpr intrusive_stack() noexcept = default;
+    ~intrusive_stack() = default;
+
+    intrusive_stack(const intrusive_stack&) = delete;
+    auto operator=(const intrusive_stack&) -> intrusive_stack& = delete;
+
+    static auto is_lock_free() noexcept -> bool { return AO_stack_is_lock_free() != 0; }
+
+    // Release ordering: writes to *element before the push are visible to
+    // the thread that pops it.
+    auto push(T& element) noexcept -> void { AO_stack_push_release(&stack_, to_link(&element)); }
+
+    // Acquire ordering; returns nullptr if the stack is empty.
+    auto pop() noexcept -> T*
+    {
+        AO_uintptr_t* link = AO_stack_pop_acquire(&stack_);
+        return link != nullptr ? from_link(link) : nullptr;
+    }
+
+    auto try_pop(T*& element) noexcept -> bool
+    {
+        T* popped = pop();
+        if(popped == nullptr) {
+            return false;
+        }
+        element = popped;
+        return true;
+    }
+
+    // A snapshot, which concurrent pushes and pops may outdate at once.
+    auto empty() const noexcept -> bool { return AO_stack_head_ptr(&stack_) == nullptr; }
+
+    // Empties the stack without touching its elements; not safe against
+    // concurrent push or pop.
+    auto reset() noexcept -> void { AO_stack_init(&stack_); }
+
+    auto native_handle() noexcept -> AO_stack_t* { return &stack_; }
+
+private:
+    static auto to_link(T* element) noexcept -> AO_uintptr_t*
+    {
+        return reinterpret_cast<AO_uintptr_t*>(reinterpret_cast<unsigned char*>(element) + LinkOffset);
+    }
+
+    static auto from_link(AO_uintptr_t* link) noexcept -> T*
+    {
+        return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(link) - LinkOffset);
+    }
+
+    AO_stack_t stack_ = AO_STACK_INITIALIZER;
+};
+
+} // namespace ao
@@ -0,0 +1,275 @@
+// Checks of the ao::atomic wrappers in atomic.hpp: the AO_char/short/int/
+// AO_t width selection, the pointer specialization, the two-word path and
+// the _ref variants, plus wait() woken up by another thread, and the
+// intrusive_stack of atomic_stack.hpp (if built with atomic_ops_gpl).
+
+#include "atomic.hpp"
+
+// Decided before atomic_ops_stack.h, which may supply an AO_double_t of
+// its own that atomic.hpp has not seen.
+#if defined(AO_HAVE_double_t)
+#define TEST_DOUBLE
+#endif
+
+#if defined(AO_TEST_STACK)
+#include "atomic_stack.hpp"
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if(!(cond)) {                                                          \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            std::abort();                                                      \
+        }                                                                      \
+    } while(0)
+
+namespace {
+
+template<typename T>
+auto test_integral() -> void
+{
+    ao::atomic<T> a{T(5)};
+    CHECK(a.load(std::memory_order_relaxed) == T(5));
+    a.store(T(7), std::memory_order_release);
+    CHECK(a.template load<std::memory_order_acquire>() == T(7));
+
+    CHECK(a.fetch_add(T(3)) == T(7));
+    CHECK(a.fetch_sub(T(2), std::memory_order_acq_rel) == T(10));
+    CHECK(a.fetch_add1() == T(8));
+    CHECK(a.fetch_sub1() == T(9));
+    CHECK(++a == T(9));
+    CHECK(a-- == T(9));
+    CHECK((a += T(4)) == T(12));
+    CHECK((a -= T(2)) == T(10));
+
+    CHECK(a.fetch_and(T(6)) == T(10));
+    CHECK(a.fetch_or(T(9)) == T(2));
+    CHECK(a.fetch_xor(T(1)) == T(11));
+    a &= T(14);
+    a |= T(1);
+    a ^= T(4);
+    CHECK(a.load(std::memory_order_seq_cst) == T(15));
+
+    T expected = T(1);
+    CHECK(!a.compare_exchange_strong(expected, T(2), std::memory_order_release,
+                                     std::memory_order_acquire));
+    CHECK(expected == T(15));
+    CHECK(a.compare_exchange_weak(expected, T(2), std::memory_order_relaxed));
+    CHECK(a.load(std::memory_order_relaxed) == T(2));
+
+    // Returns at once, the value already differs.
+    a.wait(T(0));
+    a.notify_all();
+}
+
+auto test_non_integral() -> void
+{
+    ao::atomic<float> f{1.5f};
+    f.store(1, std::memory_order_relaxed);
+    CHECK(f.load(std::memory_order_relaxed) == 1.0f);
+    f.store<std::memory_order_release>(2);
+    CHECK(f.load(std::memory_order_acquire) == 2.0f);
+
+    float expected = 2.0f;
+    CHECK(f.compare_exchange_strong(expected, 2.5f, std::memory_order_seq_cst));
+    CHECK(f.load(std::memory_order_seq_cst) == 2.5f);
+
+    enum class color : unsigned char { red, green };
+    ao::atomic<color> c{color::red};
+    c.store(color::green, std::memory_order_release);
+    CHECK(c.load(std::memory_order_acquire) == color::green);
+}
+
+auto test_pointer() -> void
+{
+    static int items[4];
+    ao::atomic<int*> p{items};
+    CHECK(p.fetch_add(2) == items);
+    CHECK(p.load(std::memory_order_acquire) == items + 2);
+    CHECK(--p == items + 1);
+    CHECK((p += 3) == items + 4);
+    CHECK(p.fetch_sub(4, std::memory_order_relaxed) == items + 4);
+
+    int* expected = nullptr;
+    CHECK(!p.compare_exchange_strong(expected, items + 3, std::memory_order_relaxed,
+                                     std::memory_order_acquire));
+    CHECK(expected == items);
+    CHECK(p.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel));
+    p.wait(items);
+    p.notify_one();
+
+    ao::atomic<int*> null_init{nullptr};
+    CHECK(null_init.load(std::memory_order_relaxed) == nullptr);
+}
+
+auto test_ref() -> void
+{
+    alignas(sizeof(AO_t)) AO_t word = 3;
+    ao::atomic_ref<AO_t> w{word};
+    CHECK(w.fetch_add(4) == 3);
+    CHECK(word == 7);
+
+    alignas(sizeof(int)) int value = 1;
+    ao::atomic_ref<int> r{value};
+    r.store(9, std::memory_order_release);
+    CHECK(value == 9);
+
+    int* ptr = nullptr;
+    ao::atomic_ref<int*> pr{ptr};
+    pr.store(&value, std::memory_order_relaxed);
+    CHECK(ptr == &value);
+}
+
+// The waiters announce themselves before blocking; the sleep gives them
+// time to get past the spinning phase of wait() and into the kernel.
+template<typename T>
+auto test_wait_notify(int waiters, bool all) -> void
+{
+    ao::atomic<T> value{T(0)};
+    ao::atomic<int> started{0};
+    ao::atomic<int> woken{0};
+    std::thread threads[2];
+    for(int i = 0; i < waiters; ++i) {
+        threads[i] = std::thread([&] {
+            started.fetch_add1();
+            value.wait(T(0), std::memory_order_acquire);
+            CHECK(value.load(std::memory_order_relaxed) == T(1));
+            woken.fetch_add1();
+        });
+    }
+    while(started.load(std::memory_order_acquire) != waiters)
+        std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(woken.load(std::memory_order_relaxed) == 0);
+
+    value.store(T(1), std::memory_order_release);
+    if(all)
+        value.notify_all();
+    else
+        value.notify_one();
+    for(int i = 0; i < waiters; ++i)
+        threads[i].join();
+    CHECK(woken.load(std::memory_order_relaxed) == waiters);
+}
+
+#if defined(TEST_DOUBLE)
+struct two_words
+{
+    AO_t lo;
+    AO_t hi;
+};
+
+auto test_double() -> void
+{
+    ao::atomic<two_words> a{two_words{1, 2}};
+    auto v = a.load(std::memory_order_acquire);
+    CHECK(v.lo == 1 && v.hi == 2);
+
+    two_words expected{1, 3};
+    CHECK(!a.compare_exchange_strong(expected, two_words{4, 5}, std::memory_order_release,
+                                     std::memory_order_acquire));
+    CHECK(expected.lo == 1 && expected.hi == 2);
+    CHECK(a.compare_exchange_strong(expected, two_words{4, 5}, std::memory_order_seq_cst));
+    v = a.exchange(two_words{6, 7});
+    CHECK(v.lo == 4 && v.hi == 5);
+    a.wait(two_words{0, 0});
+    a.notify_all();
+
+    ao::datomic<AO_t, AO_t> d{1, 2};
+    auto pair = d.load_optimistic();
+    CHECK(pair.first == 1 && pair.second == 2);
+    AO_t second = 2;
+    CHECK(d.compare_exchange_second(second, 8, std::memory_order_release,
+                                    std::memory_order_acquire));
+    CHECK(d.load(std::memory_order_relaxed).second == 8);
+
+    AO_double_t raw{};
+    ao::datomic_ref<AO_t, AO_t> dr{raw};
+    dr.store(3, 4, std::memory_order_release);
+    CHECK(raw.AO_val1 == 3 && raw.AO_val2 == 4);
+
+    static int node;
+    ao::tagged_ptr<int> top{nullptr};
+    auto old_top = top.load(std::memory_order_acquire);
+    CHECK(top.compare_exchange_strong(old_top, &node, std::memory_order_acq_rel));
+    CHECK(top.load(std::memory_order_relaxed).first == 1);
+}
+#endif
+
+#if defined(AO_TEST_STACK)
+// The link is not the first member, so that a wrong offset shows up.
+struct node
+{
+    int value;
+    AO_uintptr_t link;
+};
+
+auto test_intrusive_stack() -> void
+{
+    static node nodes[3] = {{0, 0}, {1, 0}, {2, 0}};
+    ao::intrusive_stack<node, offsetof(node, link)> stack;
+
+#if defined(AO_STACK_IS_LOCK_FREE)
+    CHECK(stack.is_lock_free());
+#else
+    CHECK(!stack.is_lock_free());
+#endif
+    CHECK(stack.empty());
+    CHECK(stack.pop() == nullptr);
+    node* popped = nullptr;
+    CHECK(!stack.try_pop(popped) && popped == nullptr);
+
+    for(auto& n : nodes) {
+        stack.push(n);
+    }
+    CHECK(!stack.empty());
+    CHECK(stack.pop() == &nodes[2]);
+    CHECK(stack.try_pop(popped) && popped == &nodes[1]);
+    CHECK(popped->value == 1);
+    stack.push(nodes[1]);
+    CHECK(stack.pop() == &nodes[1]);
+    CHECK(stack.pop() == &nodes[0]);
+    CHECK(stack.empty());
+}
+#endif
+
+} // namespace
+
+auto main() -> int
+{
+#if defined(AO_HAVE_char_fetch_compare_and_swap_full) && !defined(AO_USE_PTHREAD_DEFS)
+    static_assert(ao::atomic<unsigned char>::is_always_lock_free);
+#endif
+#if defined(AO_USE_PTHREAD_DEFS)
+    static_assert(!ao::atomic<int>::is_always_lock_free);
+#endif
+    test_integral<unsigned char>();
+    test_integral<short>();
+    test_integral<int>();
+    test_integral<long>();
+    test_non_integral();
+    test_pointer();
+    test_ref();
+#if defined(TEST_DOUBLE)
+    test_double();
+#endif
+    test_wait_notify<int>(1, false);          // parks on the value itself
+    test_wait_notify<unsigned char>(2, true); // parks on the slot epoch
+#if defined(AO_TEST_STACK)
+    test_intrusive_stack();
+#endif
+
+    ao::spinlock lock;
+    lock.lock();
+    CHECK(!lock.try_lock());
+    lock.unlock();
+
+    std::printf("SUCCEEDED\n");
+    return 0;
+}
@@ -60,8 +60,12 @@ void test_atomic(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double) \
      || defined(AO_HAVE_compare_double_and_swap_double) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double) \
      || defined(AO_HAVE_double_compare_and_swap)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -542,6 +546,20 @@ void test_atomic(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double)
+    fetched_w = AO_fetch_compare_double_and_swap_double(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double)
     TA_assert(!AO_compare_and_swap_double(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -662,8 +680,12 @@ void test_atomic_release(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_release)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_release) \
      || defined(AO_HAVE_compare_double_and_swap_double_release) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double_release) \
      || defined(AO_HAVE_double_compare_and_swap_release)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -1144,6 +1166,20 @@ void test_atomic_release(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_release)
+    fetched_w = AO_fetch_compare_double_and_swap_double_release(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double_release(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_release(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_release(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_release)
     TA_assert(!AO_compare_and_swap_double_release(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -1264,8 +1300,12 @@ void test_atomic_acquire(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_acquire) \
      || defined(AO_HAVE_compare_double_and_swap_double_acquire) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire) \
      || defined(AO_HAVE_double_compare_and_swap_acquire)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -1746,6 +1786,20 @@ void test_atomic_acquire(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire)
+    fetched_w = AO_fetch_compare_double_and_swap_double_acquire(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double_acquire(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_acquire(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_acquire(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_acquire)
     TA_assert(!AO_compare_and_swap_double_acquire(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -1866,8 +1920,12 @@ void test_atomic_read(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_read)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_read) \
      || defined(AO_HAVE_compare_double_and_swap_double_read) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double_read) \
      || defined(AO_HAVE_double_compare_and_swap_read)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -2348,6 +2406,20 @@ void test_atomic_read(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_read)
+    fetched_w = AO_fetch_compare_double_and_swap_double_read(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double_read(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_read(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_read(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_read)
     TA_assert(!AO_compare_and_swap_double_read(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -2468,8 +2540,12 @@ void test_atomic_write(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_write)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_write) \
      || defined(AO_HAVE_compare_double_and_swap_double_write) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double_write) \
      || defined(AO_HAVE_double_compare_and_swap_write)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -2950,6 +3026,20 @@ void test_atomic_write(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_write)
+    fetched_w = AO_fetch_compare_double_and_swap_double_write(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double_write(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_write(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_write(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_write)
     TA_assert(!AO_compare_and_swap_double_write(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -3070,8 +3160,12 @@ void test_atomic_full(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_full)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_full) \
      || defined(AO_HAVE_compare_double_and_swap_double_full) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double_full) \
      || defined(AO_HAVE_double_compare_and_swap_full)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -3552,6 +3646,20 @@ void test_atomic_full(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_full)
+    fetched_w = AO_fetch_compare_double_and_swap_double_full(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double_full(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_full(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_full(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_full)
     TA_assert(!AO_compare_and_swap_double_full(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -3672,8 +3780,12 @@ void test_atomic_release_write(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_release_write)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_release_write) \
      || defined(AO_HAVE_compare_double_and_swap_double_release_write) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double_release_write) \
      || defined(AO_HAVE_double_compare_and_swap_release_write)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -4154,6 +4266,20 @@ void test_atomic_release_write(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_release_write)
+    fetched_w = AO_fetch_compare_double_and_swap_double_release_write(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double_release_write(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_release_write(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_release_write(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_release_write)
     TA_assert(!AO_compare_and_swap_double_release_write(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -4274,8 +4400,12 @@ void test_atomic_acquire_read(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire_read)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_acquire_read) \
      || defined(AO_HAVE_compare_double_and_swap_double_acquire_read) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire_read) \
      || defined(AO_HAVE_double_compare_and_swap_acquire_read)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -4756,6 +4886,20 @@ void test_atomic_acquire_read(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_acquire_read)
+    fetched_w = AO_fetch_compare_double_and_swap_double_acquire_read(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double_acquire_read(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_acquire_read(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_acquire_read(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_acquire_read)
     TA_assert(!AO_compare_and_swap_double_acquire_read(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -4876,8 +5020,12 @@ void test_atomic_dd_acquire_read(void)
     static AO_double_t old_w; /* static to avoid misalignment */
     AO_double_t new_w;
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_dd_acquire_read)
+    AO_double_t fetched_w;
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_dd_acquire_read) \
      || defined(AO_HAVE_compare_double_and_swap_double_dd_acquire_read) \
+     || defined(AO_HAVE_fetch_compare_double_and_swap_double_dd_acquire_read) \
      || defined(AO_HAVE_double_compare_and_swap_dd_acquire_read)
     static AO_double_t w; /* static to avoid misalignment */
     w.AO_val1 = 0;
@@ -5358,6 +5506,20 @@ void test_atomic_dd_acquire_read(void)
 # else
     MISSING(AO_compare_double_and_swap_double);
 # endif
+# if defined(AO_HAVE_fetch_compare_double_and_swap_double_dd_acquire_read)
+    fetched_w = AO_fetch_compare_double_and_swap_double_dd_acquire_read(&w, 17, 42, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+    fetched_w = AO_fetch_compare_double_and_swap_double_dd_acquire_read(&w, 0, 0, 12, 13);
+    TA_assert(fetched_w.AO_val1 == 0 && fetched_w.AO_val2 == 0);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_dd_acquire_read(&w, 12, 14, 64, 33);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 12 && w.AO_val2 == 13);
+    fetched_w = AO_fetch_compare_double_and_swap_double_dd_acquire_read(&w, 12, 13, 0, 0);
+    TA_assert(fetched_w.AO_val1 == 12 && fetched_w.AO_val2 == 13);
+    TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
+# endif
 # if defined(AO_HAVE_compare_and_swap_double_dd_acquire_read)
     TA_assert(!AO_compare_and_swap_double_dd_acquire_read(&w, 17, 12, 13));
     TA_assert(w.AO_val1 == 0 && w.AO_val2 == 0);
@@ -101,6 +101,29 @@ typedef union le_u {
   static AO_stack_t the_list = AO_STACK_INITIALIZER;
 #endif
 
+static AO_stack_elim_t the_elim_list = AO_STACK_ELIM_INITIALIZER;
+
+/* Whether the experiments go through the_elim_list instead.    */
+static int use_elim = 0;
+
+/* The stack the experiments currently operate on.              */
+#define cur_list (use_elim ? &the_elim_list.AO_stack : &the_list)
+
+static void push_element(AO_uintptr_t *e)
+{
+  if (use_elim) {
+    AO_stack_elim_push(&the_elim_list, e);
+  } else {
+    AO_stack_push(&the_list, e);
+  }
+}
+
+static AO_uintptr_t *pop_element(void)
+{
+  return use_elim ? AO_stack_elim_pop(&the_elim_list)
+                  : AO_stack_pop(&the_list);
+}
+
 /* Add elements from 1 to n to the list (1 is pushed first).    */
 /* This is called from a single thread only.                    */
 static void add_elements(int n)
@@ -117,7 +140,7 @@ static void add_elements(int n)
     le->e.next = 0; /* mark field as used */
 # endif
   le->e.data = n;
-  AO_stack_push(&the_list, &le->next);
+  push_element(&le->next);
 }
 
 #ifdef VERBOSE_STACK
@@ -125,7 +148,7 @@ static void add_elements(int n)
   {
     AO_uintptr_t *p;
 
-    for (p = AO_REAL_HEAD_PTR(the_list);
+    for (p = AO_REAL_HEAD_PTR(*cur_list);
          p != NULL; p = AO_REAL_NEXT_PTR(*p))
       printf("%d\n", ((list_element *)p)->e.data);
   }
@@ -145,7 +168,7 @@ static void check_list(int n)
     exit(2);
   }
 
-  for (p = AO_REAL_HEAD_PTR(the_list);
+  for (p = AO_REAL_HEAD_PTR(*cur_list);
        p != NULL; p = AO_REAL_NEXT_PTR(*p)) {
     i = ((list_element *)p)->e.data;
     if (i > n || i <= 0) {
@@ -168,6 +191,155 @@ static void check_list(int n)
   if (err_cnt > 0) abort();
 }
 
+/* Check that a sharded stack hands out every element once, including */
+/* those of the sub-stacks the current thread does not map to.         */
+static void test_sharded_stack(void)
+{
+  static AO_sharded_stack_t sharded = AO_SHARDED_STACK_INITIALIZER;
+  static list_element elems[2 * AO_STACK_SHARDS];
+  AO_uintptr_t *p;
+  int i;
+  int cnt = 0;
+
+  for (i = 0; i < AO_STACK_SHARDS; ++i) {
+    elems[i].e.data = i + 1;
+    AO_stack_push(&sharded.AO_shard[i].AO_stack, &elems[i].next);
+  }
+  for (; i < 2 * AO_STACK_SHARDS; ++i) {
+    elems[i].e.data = i + 1;
+    AO_sharded_stack_push(&sharded, &elems[i].next);
+  }
+  while ((p = AO_sharded_stack_pop(&sharded)) != NULL) {
+    i = ((list_element *)p)->e.data;
+    if (i <= 0 || i > 2 * AO_STACK_SHARDS || elems[i - 1].e.data < 0) {
+      fprintf(stderr, "Sharded stack: bad or duplicate element %d\n", i);
+      abort();
+    }
+    elems[i - 1].e.data = -i;
+    cnt++;
+  }
+# ifdef AO_HAVE_sharded_stack_approx_size
+    if (AO_sharded_stack_approx_size(&sharded) != 0) {
+      fprintf(stderr, "Sharded stack: nonzero approximate size\n");
+      abort();
+    }
+# endif
+  if (cnt != 2 * AO_STACK_SHARDS) {
+    fprintf(stderr, "Sharded stack: %d elements missing\n",
+            2 * AO_STACK_SHARDS - cnt);
+    abort();
+  }
+}
+
+/* Check the LIFO order of an index stack and that it ends up empty.   */
+static void test_index_stack(void)
+{
+  static AO_index_stack_t istack = AO_INDEX_STACK_INITIALIZER;
+  static volatile AO_t links[10];
+  AO_t i;
+
+  for (i = 0; i < 10; ++i)
+    AO_index_stack_push(&istack, links, i);
+  for (i = 10; i-- > 0; ) {
+    AO_t index = AO_index_stack_pop(&istack, links);
+
+    if (index != i) {
+      fprintf(stderr, "Index stack: popped %lu instead of %lu\n",
+              (unsigned long)index, (unsigned long)i);
+      abort();
+    }
+  }
+  if (AO_index_stack_pop(&istack, links) != AO_INDEX_STACK_EMPTY) {
+    fprintf(stderr, "Index stack: not empty\n");
+    abort();
+  }
+}
+
+/* Check that AO_stack_pop_wait times out on an empty stack and does   */
+/* not wait if there is an element.                                     */
+static void test_pop_wait(void)
+{
+  static AO_stack_t wstack = AO_STACK_INITIALIZER;
+  static list_element elem;
+
+  if (AO_stack_pop_wait(&wstack, 0) != NULL
+      || AO_stack_pop_wait(&wstack, 2) != NULL) {
+    fprintf(stderr, "Pop wait: non-NULL from an empty stack\n");
+    abort();
+  }
+  AO_stack_push(&wstack, &elem.next);
+  if (AO_stack_pop_wait(&wstack, -1) != &elem.next) {
+    fprintf(stderr, "Pop wait: wrong element\n");
+    abort();
+  }
+}
+
+static AO_stack_elim_t wait_stack = AO_STACK_ELIM_INITIALIZER;
+static volatile AO_t waiter_started = 0;
+
+/* Wait (with no timeout) for arg to be pushed to wait_stack.   */
+#ifdef USE_WINTHREADS
+  static DWORD WINAPI wait_for_push(LPVOID arg)
+#else
+  static void * wait_for_push(void * arg)
+#endif
+{
+  AO_store_release(&waiter_started, 1);
+  if (AO_stack_pop_wait(&wait_stack.AO_stack, -1) != (AO_uintptr_t *)arg) {
+    fprintf(stderr, "Pop wait: wrong element after wake-up\n");
+    abort();
+  }
+  return 0;
+}
+
+/* Another thread parks on the empty stack, the push of this one (by    */
+/* AO_stack_elim_push if elim) must wake it up.                         */
+static void test_pop_wait_wakeup(int elim)
+{
+  static AO_stack_t idle = AO_STACK_INITIALIZER;
+  static list_element elem;
+  int code;
+# ifdef USE_WINTHREADS
+    DWORD thread_id;
+    HANDLE thread;
+# else
+    pthread_t thread;
+# endif
+
+  AO_store(&waiter_started, 0);
+# ifdef USE_WINTHREADS
+    thread = CreateThread(NULL, 0, wait_for_push, (LPVOID)&elem.next, 0,
+                          &thread_id);
+    code = thread != NULL ? 0 : (int)GetLastError();
+# else
+    code = pthread_create(&thread, 0, wait_for_push, &elem.next);
+# endif
+  if (code != 0) {
+    fprintf(stderr, "Thread creation failed %u\n", (unsigned)code);
+    exit(3);
+  }
+  while (!AO_load_acquire(&waiter_started)) {
+    /* Wait for the thread to start.  */
+  }
+  /* Give the waiter time to get past the spinning and to park.   */
+  (void)AO_stack_pop_wait(&idle, 20);
+  if (elim) {
+    AO_stack_elim_push(&wait_stack, &elem.next);
+  } else {
+    AO_stack_push(&wait_stack.AO_stack, &elem.next);
+  }
+# ifdef USE_WINTHREADS
+    code = WaitForSingleObject(thread, INFINITE) == WAIT_OBJECT_0 ?
+                0 : (int)GetLastError();
+# else
+    code = pthread_join(thread, 0);
+# endif
+  if (code != 0) {
+    fprintf(stderr, "Thread join failed %u\n", (unsigned)code);
+    abort();
+  }
+}
+
 static volatile AO_t ops_performed = 0;
 
 #ifndef LIMIT
@@ -212,7 +384,7 @@ static volatile AO_t ops_performed = 0;
     /* push them back (in the same order of operations).            */
     /* Note that this is done in parallel by many threads.          */
     for (i = 0; i <= index; ++i) {
-      t[i] = AO_stack_pop(&the_list);
+      t[i] = pop_element();
       if (NULL == t[i]) {
         /* This should not happen as at most n*(n+1)/2 elements */
         /* could be popped off at a time.                       */
@@ -220,8 +392,16 @@ static volatile AO_t ops_performed = 0;
         abort();
       }
     }
-    for (i = 0; i <= index; ++i) {
-      AO_stack_push(&the_list, t[i]);
+    if ((index & 1) != 0) {
+      /* Link the popped elements privately and push them back as a */
+      /* single chain.                                              */
+      for (i = 0; i < index; ++i)
+        *t[i] = (AO_uintptr_t)t[i + 1];
+      AO_stack_push_list(cur_list, t[0], t[index]);
+    } else {
+      for (i = 0; i <= index; ++i) {
+        push_element(t[i]);
+      }
     }
 #   ifdef VERBOSE_STACK
       j += index + 1;
@@ -265,7 +445,7 @@ static void run_one_experiment(int max_nthreads, int exper_n)
              exper_n, nthreads, max_nthreads, list_length);
 #   endif
     /* Create a list with n*(n+1)/2 elements.   */
-    assert(0 == AO_REAL_HEAD_PTR(the_list));
+    assert(0 == AO_REAL_HEAD_PTR(*cur_list));
     add_elements(list_length);
 #   ifdef VERBOSE_STACK
       printf("Initial list (nthreads = %d):\n", nthreads);
@@ -317,9 +497,21 @@ static void run_one_experiment(int max_nthreads, int exper_n)
 #   endif
     /* Ensure that no element is lost or duplicated.    */
     check_list(list_length);
+#   ifdef AO_HAVE_stack_approx_size
+      if (AO_stack_approx_size(cur_list) != (AO_t)list_length) {
+        fprintf(stderr, "Wrong approximate size %lu (expected %d)\n",
+                (unsigned long)AO_stack_approx_size(cur_list), list_length);
+        abort();
+      }
+#   endif
     /* And, free the entire list.   */
-    while ((le = AO_stack_pop(&the_list)) != NULL)
+    le = AO_stack_pop_all(cur_list);
+    while (le != NULL) {
+      AO_uintptr_t *next = AO_REAL_NEXT_PTR(*le);
+
       free(le);
+      le = next;
+    }
     /* Retry with larger n values.      */
   }
 }
@@ -378,8 +570,18 @@ int main(int argc, char **argv)
     printf("Use almost-lock-free implementation\n");
 # if defined(CPPCHECK)
     AO_stack_init(&the_list);
+    AO_stack_elim_init(&the_elim_list);
     (void)AO_stack_next_ptr(0);
 # endif
+  test_sharded_stack();
+  test_index_stack();
+  test_pop_wait();
+  test_pop_wait_wakeup(0);
+  test_pop_wait_wakeup(1);
+  run_all_experiments(max_nthreads);
+  output_stat(max_nthreads);
+  printf("With elimination back-off:\n");
+  use_elim = 1;
   run_all_experiments(max_nthreads);
   output_stat(max_nthreads);
   return 0;